@@ -0,0 +1,270 @@
+/*
+*  Host benchmarks of the feeder firmware ([env:bench], [env:bench64], [env:bench128]).
+*
+*  Runs the firmware sources against the stand-ins in sim/ and measures wall clock time per
+*  operation of the parser, of command processing, of the motion engine and of whole loop()
+*  iterations under a feed workload. I²C transactions and calls into Serial are
+*  counted per operation, too: they are what costs bus or port time on the controller.
+*  Replies and servo changes only go out later from loop(), so they are sent right after each
+*  command or motion step and counted to it, outside the timed part.
+*
+*  usage: bench [-s scale]
+*    -s    multiply the number of operations, default 1
+*
+*  output: one JSON object per line and benchmark, e.g.
+*    {"bench":"command","case":"M601 N3","feeders":32,"ops":20000,"ns_per_op":263.5,"i2c_transactions_per_op":0.000,"serial_calls_per_op":84.000}
+*/
+
+#include "Sim.h"
+#include "Feeder.h"
+#include "SerialTx.h"
+#include "I2CQueue.h"
+#include "gcode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+// firmware, src/main.cpp
+void setup();
+void loop();
+void processCommand();
+bool flushServoControllers();
+extern FeederClass feeders[];
+
+static unsigned long scale = 1;
+
+// lines as OpenPnP and the setup tools send them
+static const char *const corpus[] = {
+	"M600 N3",
+	"M600 N17 F4",
+	"M600 N5 F2 X1",
+	"M601 N3",
+	"M601 N17",
+	"M620 N3 A90 B45 C10 F4 U240 V500 W2400",
+	"M620 N5 S1.5 R2.25 P0.05 Q0.05",
+	"M630 N3",
+};
+
+struct sMeasurement {
+	std::chrono::steady_clock::time_point begin;
+	sim::Counters counters;
+};
+
+static void startMeasurement(sMeasurement *m) {
+	m->counters = sim::counters;
+	m->begin = std::chrono::steady_clock::now();
+}
+
+static uint64_t elapsedNs(const sMeasurement *m) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m->begin).count();
+}
+
+static void report(const char *bench, const char *name, unsigned long ops, uint64_t ns, unsigned long i2cTransactions, unsigned long serialCalls) {
+	printf("{\"bench\":\"%s\",\"case\":\"%s\",\"feeders\":%d,\"ops\":%lu,\"ns_per_op\":%.1f,\"i2c_transactions_per_op\":%.3f,\"serial_calls_per_op\":%.3f}\n",
+		bench, name, NUMBER_OF_FEEDER, ops, (double)ns / ops, (double)i2cTransactions / ops, (double)serialCalls / ops);
+	fflush(stdout);
+}
+
+static void setInputLine(const char *line) {
+	inputBufferLength = strlen(line);
+	memcpy(inputBuffer, line, inputBufferLength);
+}
+
+// let the firmware send what it queued (replies and dirty servo channels), advancing virtual time only
+static void flushOutput() {
+	serialTx.flush();
+	while (flushServoControllers())
+		i2cQueueWait();
+	i2cQueueWait();
+}
+
+// run loop() for /ms/ of virtual time, 100 µs per iteration like the simulator
+static void runLoop(unsigned long ms) {
+	uint64_t end = sim::now() + (uint64_t)ms * 1000;
+	while (sim::now() < end) {
+		loop();
+		sim::advance(100);
+	}
+}
+
+static void benchParse() {
+	unsigned long ops = 100000 * scale;
+
+	for (const char *line : corpus) {
+		setInputLine(line);
+		int32_t sum = 0;
+		sMeasurement m;
+		startMeasurement(&m);
+		for (unsigned long i = 0; i < ops; i++) {
+			parseGCodeLine();
+			sum += parseParameter('M', -1) + parseParameter('N', -1) + parseParameter('F', 0);
+		}
+		uint64_t ns = elapsedNs(&m);
+		if (sum == 42)		// keep the result alive
+			putchar(' ');
+		report("parse", line, ops, ns, sim::counters.i2cTransactions - m.counters.i2cTransactions, sim::counters.serialCalls - m.counters.serialCalls);
+	}
+}
+
+// whole command: parse, checks, feeder call and answer. The feeder is reset between commands, not timed
+static void benchCommand() {
+	unsigned long ops = 20000 * scale;
+
+	for (const char *line : corpus) {
+		uint64_t ns = 0;
+		unsigned long i2cTransactions = 0;
+		unsigned long serialCalls = 0;
+
+		setInputLine(line);
+		parseGCodeLine();
+		uint16_t feederNo = parseParameter('N', 0);
+
+		for (unsigned long i = 0; i < ops; i++) {
+			setInputLine(line);
+			sMeasurement m;
+			startMeasurement(&m);
+			processCommand();
+			ns += elapsedNs(&m);
+			flushOutput();
+			i2cTransactions += sim::counters.i2cTransactions - m.counters.i2cTransactions;
+			serialCalls += sim::counters.serialCalls - m.counters.serialCalls;
+
+			feeders[feederNo].enable();
+			flushOutput();
+		}
+		report("command", line, ops, ns, i2cTransactions, serialCalls);
+	}
+}
+
+// one ms step of a move, over full strokes back and forth
+static void benchMotion() {
+	struct sSpeedCase {
+		const char *name;
+		uint16_t speed;				// 1/256 degree per ms, 0 unlimited
+		uint16_t acceleration;		// 1/4096 degree per ms², 0 none
+	};
+	static const sSpeedCase speedCases[] = {
+		{ "unlimited", 0, 0 },
+		{ "speed 0.1deg/ms", 26, 0 },
+		{ "speed 1deg/ms", 256, 0 },
+		{ "speed 1deg/ms accel 0.01deg/ms2", 256, 41 },
+		{ "speed 4deg/ms accel 0.05deg/ms2", 1024, 205 },
+	};
+	unsigned long ops = 200000 * scale;
+	FeederClass &feeder = feeders[0];
+	FeederClass::sFeederSettings original = feeder.getSettings();
+
+	for (const sSpeedCase &speedCase : speedCases) {
+		FeederClass::sFeederSettings settings = original;
+		settings.advance_angle_speed = settings.retract_angle_speed = speedCase.speed;
+		settings.advance_angle_acceleration = settings.retract_angle_acceleration = speedCase.acceleration;
+		feeder.setSettings(settings);
+
+		//timed, then the same strokes again with every step flushed, as loop() would, to count the I²C writes
+		uint64_t ns = 0;
+		sim::Counters start = sim::counters;
+		for (uint8_t pass = 0; pass < 2; pass++) {
+			bool flush = (pass == 1);
+			bool advancing = true;
+			feeder.gotoAngle(settings.retract_angle);
+			flushOutput();
+			start = sim::counters;
+			feeder.targetPosition() = (uint16_t)settings.full_advanced_angle << 8;
+			sMeasurement m;
+			startMeasurement(&m);
+			for (unsigned long i = 0; i < ops; i++) {
+				if (!feeder.moveServoToTarget(1)) {
+					advancing = !advancing;
+					feeder.targetPosition() = (uint16_t)(advancing ? settings.full_advanced_angle : settings.retract_angle) << 8;
+				}
+				if (flush)
+					flushOutput();
+			}
+			if (!flush)
+				ns = elapsedNs(&m);
+		}
+		report("motion", speedCase.name, ops, ns, sim::counters.i2cTransactions - start.i2cTransactions, sim::counters.serialCalls - start.serialCalls);
+	}
+
+	feeder.setSettings(original);
+	feeder.gotoRetractPosition();
+}
+
+/*
+*  loop() while a job runs, sped up: every 5 ms of virtual time a command, mostly M600 to a random
+*  feeder together with the M601 (post pick) of the feeder advanced 500 ms before, now and then a
+*  settings query or change. Feeders still busy queue the advance (or refuse it), as on the machine.
+*/
+static void benchLoop() {
+	unsigned long loops = 200000 * scale;
+	uint32_t random = 12345;
+	uint8_t advanced[100];		// feeders of the last 100 advances, oldest first
+	uint8_t advancedNext = 0;
+	char line[64];
+
+	memset(advanced, 0, sizeof(advanced));
+
+	uint64_t ns = 0;
+	sim::Counters start = sim::counters;
+
+	for (unsigned long i = 0; i < loops; i++) {
+		if (i % 50 == 0) {
+			random = random * 1103515245 + 12345;
+			unsigned int feederNo = (random >> 16) % NUMBER_OF_FEEDER;
+			switch ((random >> 8) % 16) {
+				case 0:
+					snprintf(line, sizeof(line), "M630 N%u\n", feederNo);
+					break;
+				case 1:
+					snprintf(line, sizeof(line), "M620 N%u U%u\n", feederNo, 200 + (random >> 4) % 100);
+					break;
+				default:
+					snprintf(line, sizeof(line), "M601 N%u\nM600 N%u\n", advanced[advancedNext], feederNo);
+					advanced[advancedNext] = feederNo;
+					advancedNext = (advancedNext + 1) % sizeof(advanced);
+					break;
+			}
+			sim::feedSerial(line);
+		}
+
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		loop();
+		ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+		sim::advance(100);
+	}
+
+	char name[32];
+	snprintf(name, sizeof(name), "job %d feeders", NUMBER_OF_FEEDER);
+	report("loop", name, loops, ns, sim::counters.i2cTransactions - start.i2cTransactions, sim::counters.serialCalls - start.serialCalls);
+}
+
+int main(int argc, char **argv) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			scale = strtoul(argv[++i], NULL, 10);
+		} else {
+			fprintf(stderr, "usage: %s [-s scale]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (scale == 0)
+		scale = 1;
+
+	sim::setTrace(NULL);
+
+	// boot, let the settings dump go out and enable the feeders
+	setup();
+	runLoop(5000);
+	sim::feedSerial("M610 S1\n");
+	runLoop(1000);
+
+	benchParse();
+	benchCommand();
+	benchMotion();
+	runLoop(1000);
+	benchLoop();
+
+	return 0;
+}
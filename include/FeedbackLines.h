@@ -0,0 +1,44 @@
+#ifndef _FEEDBACKLINES_h
+#define _FEEDBACKLINES_h
+
+#include "arduino.h"
+#include "config.h"
+#include "shield.h"
+
+#ifdef HAS_FEEDBACKLINES
+
+
+/*
+*  Feedback lines of all feeders, read through MCP23017 port expanders: every FEEDBACK_SCAN_MS one queued
+*  I²C transaction per expander reads its 16 lines (GPIOA and GPIOB). Once all expanders answered, the
+*  lines are debounced 8 feeders at a time with vertical counters: a line changes after 4 scans in a row
+*  read it changed. A press of the tensioner shorter than 2^FEEDBACK_HOLD_BITS scans marks a manual feed
+*  when it is released, counted the same way. The cost is the same for every scan, whatever the lines do.
+*/
+
+#define FEEDBACK_EXPANDER_BASE_ADDRESS 0x20
+#define FEEDBACK_BYTES ((NUMBER_OF_FEEDER + 7) / 8)
+
+//bus time of a scan: per expander START, address, register pointer, repeated START, address, 2 bytes read, STOP
+#define FEEDBACK_SCAN_BUS_US ((unsigned long)NUMBER_OF_EXPANDERS * (5 * 9 + 3) * 1000000UL / I2C_CLOCK_HZ)
+
+static_assert(NUMBER_OF_EXPANDERS <= 8, "an MCP23017 has 3 address pins: feedback lines for 128 feeders at most");
+static_assert(FEEDBACK_LINES_PER_EXPANDER == 16, "feedback bytes are taken as GPIOA, GPIOB of one expander after the other");
+static_assert(FEEDBACK_SCAN_BUS_US * 100 <= (unsigned long)FEEDBACK_SCAN_MS * 1000 * (100 - I2C_BUS_BUDGET_PERCENT), "feedback scans do not fit the bus time I2C_BUS_BUDGET_PERCENT leaves: raise FEEDBACK_SCAN_MS");
+
+//debounced lines, bit per feeder: set if the tensioner switch pulls the line low (cover tape tensioned)
+extern uint8_t feedbackLines[FEEDBACK_BYTES];
+//manual feeds detected and not taken yet, bit per feeder
+extern uint8_t feedbackManualFeeds[FEEDBACK_BYTES];
+
+//pull-ups on, first read taken as debounced (setup only, waits for the bus)
+void feedbackLinesBegin();
+
+//start a scan if one is due at /now/ [ms], debounce the last one once all expanders answered
+void feedbackLinesScan(unsigned long now);
+
+#endif
+
+
+
+#endif
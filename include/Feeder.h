@@ -4,12 +4,25 @@
 #include "arduino.h"
 #include "config.h"
 #include "shield.h"
+#include "ServoController.h"
 
-#include <PCA9685.h>
 #include <EEPROMex.h>
 
 
 
+//bitmaps with one bit per feeder
+inline void setFeederBit(uint8_t *bitmap, uint16_t feederNo) {
+	bitmap[feederNo >> 3] |= (uint8_t)1 << (feederNo & 7);
+}
+
+inline void clearFeederBit(uint8_t *bitmap, uint16_t feederNo) {
+	bitmap[feederNo >> 3] &= ~((uint8_t)1 << (feederNo & 7));
+}
+
+inline bool isFeederBitSet(const uint8_t *bitmap, uint16_t feederNo) {
+	return (bitmap[feederNo >> 3] & ((uint8_t)1 << (feederNo & 7))) != 0;
+}
+
 class FeederClass {
 	protected:
 
@@ -28,34 +41,44 @@ class FeederClass {
 	public:
 
 
-	//used to transfer settings between different objects
-	struct sFeederSettings {
+	//used to transfer settings between different objects.
+	//stored as is in the eeprom record (see FEEDER_SETTINGS_SCHEMA): new fields only ever go to the end,
+	//records written before get them from the defaults when loaded
+	struct __attribute__((packed)) sFeederSettings {
 		uint8_t full_advanced_angle;
 		uint8_t half_advanced_angle;
 		uint8_t retract_angle;
 		uint8_t feed_length;
-		int time_to_settle;
+		int16_t time_to_settle;
 		uint16_t advance_angle_speed;					// degree per ms in 1/256 degree resolution, 0 disable
 		uint16_t retract_angle_speed;					// degree per ms in 1/256 degree resolution, 0 disable
-		int motor_min_pulsewidth;
-		int motor_max_pulsewidth;
-
-		//sFeederState lastFeederState;       //save last position to stay there on poweron? needs something not to wear out the eeprom. until now just go to retract pos.
+		int16_t motor_min_pulsewidth;
+		int16_t motor_max_pulsewidth;
+		uint16_t advance_angle_acceleration;			// degree per ms² in 1/4096 degree per ms resolution, 0 disable
+		uint16_t retract_angle_acceleration;			// degree per ms² in 1/4096 degree per ms resolution, 0 disable
+		uint8_t ignore_feedback;						// 1: advance even if the feedback line signals an error
+		uint8_t prefeed;								// 1: pre-feed the next part right after the post pick retract (M601)
 	};
 
 	uint8_t remainingFeedLength=0;
+	uint8_t prefedLength=0;		// [mm] fed ahead by the pre-feed (running or presented), taken by the next advance
+
+	//advance requests received while the feeder was busy, started in order by update()
+	uint8_t advanceQueue[FEEDER_ADVANCE_QUEUE_LENGTH];		// feed lengths [mm], FEEDER_ADVANCE_QUEUE_BATCH flags batch advances
+	uint8_t advanceQueueHead=0;
+	uint8_t advanceQueueCount=0;
 
 	//operational status of the feeder
-	enum sFeederState {
+	enum sFeederState : uint8_t {
 		sDISABLED,
 		sIDLE,
 		sSETTLE,
 		sMOVING,
-	} feederState = sDISABLED;
+	};
 
 	//store the position of the advancing lever
 	//last state is stored to enable half advance moves (2mm tapes)
-	enum sFeederPosition {
+	enum sFeederPosition : uint8_t {
 		sAT_UNKNOWN,
 		sAT_FULL_ADVANCED_POSITION,
 		sAT_HALF_ADVANCED_POSITION,
@@ -63,17 +86,58 @@ class FeederClass {
 		sAT_UNLOAD_POSITION,
 	} feederPosition = sAT_UNKNOWN;
 
-	//store last tinestamp position changed to respect a settle time
-	unsigned long lastTimePositionChange;
-	uint16_t position = FEEDER_DEFAULT_FULL_ADVANCED_ANGLE * 256;			// 1/256 degree
-	uint16_t targetPosition = 0;											// 1/256 degree
-	bool advanceInProgress = false;
+	int16_t pwmSlope = 0;													// pwm counts per 1/256 degree, Q16. see updatePWMConversion()
+
+	/*
+	*  Motion state of all feeders, one array per field, indexed by feeder number. Kept apart from the
+	*  feeder objects (settings, queue, stats): the update sweep walks these small arrays only.
+	*  A feeder reaches its entries through the accessors below.
+	*/
+	struct sFeederMotion {
+		sFeederState state[NUMBER_OF_FEEDER];
+		uint16_t position[NUMBER_OF_FEEDER];				// 1/256 degree
+		uint16_t targetPosition[NUMBER_OF_FEEDER];			// 1/256 degree
+		uint16_t lastTimePositionChange[NUMBER_OF_FEEDER];	// [ms] low 16 bit of the time, intervals stay below 65 s
+		//motion profile, only used if an acceleration is set
+		uint16_t velocity[NUMBER_OF_FEEDER];				// 1/4096 degree per ms
+		uint16_t rampDistance[NUMBER_OF_FEEDER];			// 1/256 degree, travelled while accelerating = needed to brake
+		uint8_t positionFraction[NUMBER_OF_FEEDER];			// 1/4096 degree, below the resolution of position
+		//one bit per feeder
+		uint8_t moveAdmitted[(NUMBER_OF_FEEDER + 7) / 8];			// move counts against the motion current budget
+		uint8_t advanceInProgress[(NUMBER_OF_FEEDER + 7) / 8];
+		uint8_t advanceInBatch[(NUMBER_OF_FEEDER + 7) / 8];		// running advance belongs to a batch (M605): no own ok, clears batchAdvancePending when settled
+		uint8_t batchAdvancePending[(NUMBER_OF_FEEDER + 7) / 8];	// batch advance accepted (running or queued) and not settled yet
+		uint8_t batchAdvanceAborted[(NUMBER_OF_FEEDER + 7) / 8];	// batch advance dropped by enable/disable before it settled
+		uint8_t prefeedInProgress[(NUMBER_OF_FEEDER + 7) / 8];	// running advance is a pre-feed: no ok, the part is presented once settled
+	};
+	static sFeederMotion motion;
+
+	sFeederState &feederState() { return motion.state[this->feederNo]; }
+	uint16_t &position() { return motion.position[this->feederNo]; }
+	uint16_t &targetPosition() { return motion.targetPosition[this->feederNo]; }
+	uint16_t &lastTimePositionChange() { return motion.lastTimePositionChange[this->feederNo]; }
+	bool batchAdvancePending() { return isFeederBitSet(motion.batchAdvancePending, this->feederNo); }
+	bool batchAdvanceAborted() { return isFeederBitSet(motion.batchAdvanceAborted, this->feederNo); }
+	
+#ifdef FEEDER_STATS
+	//cycle statistics since start or the last M633 R1. counts saturate
+	struct sFeederStats {
+		uint16_t advances;				// cycles started
+		uint16_t fed;					// [2mm]
+		uint16_t cycleMin;				// [ms] cycle start to "ok"
+		uint16_t cycleMax;				// [ms]
+		uint16_t cycleAverage;			// [1/16 ms] moving average over about 8 cycles
+		uint16_t advanceStrokeAverage;	// [1/16 ms] moving average of moves away from retract
+		uint16_t retractStrokeAverage;	// [1/16 ms] moving average of moves to retract
+		uint8_t settleOverruns;			// settle time handled more than FEEDER_SETTLE_OVERRUN_MS late
+		uint8_t errors;					// advances refused, feeder not OK
+		uint8_t busy;					// advances refused, queue full
+		uint8_t dropped;				// queued advances discarded by enable/disable
+	} stats;
+	uint16_t cycleStart;				// [ms] low 16 bit of the time
+	uint16_t strokeStart;				// [ms] low 16 bit of the time
+#endif
 	
-	//some variables for utilizing the feedbackline to feed for setup the feeder...
-	uint8_t feedbackLineTickCounter=0;
-	unsigned long lastTimeFeedbacklineCheck;
-	int lastButtonState;
-
 	//permanently in eeprom stored settings
 	sFeederSettings feederSettings = {
 		FEEDER_DEFAULT_FULL_ADVANCED_ANGLE,
@@ -85,43 +149,88 @@ class FeederClass {
 		FEEDER_DEFAULT_RETRACT_ANGLE_SPEED,
 		FEEDER_DEFAULT_MOTOR_MIN_PULSEWIDTH,
 		FEEDER_DEFAULT_MOTOR_MAX_PULSEWITH,
+		FEEDER_DEFAULT_ADVANCE_ANGLE_ACCELERATION,
+		FEEDER_DEFAULT_RETRACT_ANGLE_ACCELERATION,
+		FEEDER_DEFAULT_IGNORE_FEEDBACK,
+		FEEDER_DEFAULT_PREFEED,
 	};
 
-	PCA9685 *servoController;
+	//controllers of all feeders, this feeder's channel is found by servoController()/servoChannel()
+	static ServoControllerClass *servoControllers;
+	ServoControllerClass &servoController();
+	uint8_t servoChannel();
 
 	void initialize(uint16_t _feederNo);
 	bool isInitialized();
 	bool hasFeedbackLine();
 	void outputCurrentSettings();
-	void setup(PCA9685 *controller);
+	void setup(ServoControllerClass *controllerList);
+	uint16_t lastPositionAddress();
+	void restoreLastPosition();
+	bool persistPosition(unsigned long now);
 	sFeederSettings getSettings();
 	void setSettings(sFeederSettings UpdatedFeederSettings);
-	void loadFeederSettings();
+	uint16_t settingsRecordAddress();
+	uint8_t settingsRecordByte(uint8_t offset);
+	bool loadFeederSettings();
+	void loadLegacyFeederSettings(uint8_t legacySize);
 	void saveFeederSettings();
+	uint8_t persistSettingsFrom(uint8_t offset, uint8_t maxCompares);
+	uint8_t commitSettings();
 	void factoryReset();
 
 	void gotoPostPickPosition();
+	void prefeed();
+	void clearPrefeed();
 	void gotoRetractPosition();
 	void gotoHalfAdvancedPosition();
 	void gotoFullAdvancedPosition();
 	void gotoUnloadPosition();
 	void gotoAngle(uint8_t angle);
-	bool advance(uint8_t feedLength, bool overrideError);
+	void updatePWMConversion();
+	uint16_t positionToPWM(uint16_t position);
+	bool advance(uint8_t feedLength, bool overrideError, bool inBatch = false);
 	void advanceNext();
+	bool advanceQueueIsFull();
+	void clearAdvanceQueue();
 	void startMove(uint8_t angle, sFeederPosition pos);
+	void startCycle(uint8_t feedLength);
+	void recordBusy();
+	void outputStats();
+	void resetStats();
+	static bool admitMove(unsigned long now);
+	void releaseMove();
 	bool moveServoToTarget(uint8_t ms);
+	static uint16_t nextProfileStep(uint8_t n, uint16_t distance, uint16_t speed, uint16_t acceleration);
 
-	String reportFeederErrorState();
+	const __FlashStringHelper *reportFeederErrorState();
 	bool feederIsOk();
 
 	void enable();
 	void disable();
 
-	void update();
+	bool update(unsigned long now);
+
+	//feeders that need update() calls (moving, settling), one bit per feeder
+	static uint8_t activeFeeders[(NUMBER_OF_FEEDER + 7) / 8];
+	void setActive();
+
+	//motion admission: current of the moves running, and how often moves had to wait
+	static uint16_t movingCurrent;					// [mA]
+	static unsigned long lastMoveAdmitted;
+	static uint16_t delayedMoves;
+	static uint16_t maxAdmissionWait;				// [ms]
+	static uint16_t peakMovingCurrent;				// [mA]
+
+	//feeders with settings changed in RAM but not written to eeprom yet, one bit per feeder
+	static uint8_t unsavedSettings[(NUMBER_OF_FEEDER + 7) / 8];
 };
 
 extern FeederClass Feeder;
 
+//eeprom record of a feeder's settings: schema, length, settings, crc8
+#define FEEDER_SETTINGS_RECORD_SIZE (sizeof(FeederClass::sFeederSettings) + 3)
+
 
 
 #endif
@@ -0,0 +1,60 @@
+#ifndef _I2CBUDGET_h
+#define _I2CBUDGET_h
+
+#include "arduino.h"
+#include "config.h"
+#include "shield.h"
+#include "ServoController.h"
+
+
+/*
+*  I²C bandwidth accountant.
+*  Worst case servo traffic is every servo the motion admission lets move at once (MOTION_CURRENT_BUDGET_MA)
+*  changing its channel on every flush. A flush posts no more bursts than the I²C queue holds (I2C_FLUSH_BURSTS_MAX),
+*  the channels left over go out with the next flushes. Its bus time is at worst that many bursts with as many
+*  of the moving channels as they can carry, at I2C_CLOCK_HZ. Servo flushes are spaced I2C_FLUSH_INTERVAL_MS apart
+*  so they take at most I2C_BUS_BUDGET_PERCENT of the bus. A configuration that does not compile: one whose flushes
+*  cannot update every moving servo once per servo frame, even when each moving channel takes a burst of its own. With LATENCY_STATS the bus time actually used per servo frame is
+*  kept (M632).
+*/
+
+//bits on the bus: START, address and register byte, STOP per burst, 4 register bytes per channel, 9 bits per byte with ACK
+#define I2C_BURST_OVERHEAD_BITS (1 + 2 * 9 + 1)
+#define I2C_CHANNEL_BITS (4 * 9)
+
+#if MOTION_CURRENT_BUDGET_MA > 0 && MOTION_CURRENT_BUDGET_MA / MOTION_MOVE_CURRENT_MA < NUMBER_OF_FEEDER
+#define I2C_MOVING_CHANNELS_MAX (MOTION_CURRENT_BUDGET_MA / MOTION_MOVE_CURRENT_MA)
+#else
+#define I2C_MOVING_CHANNELS_MAX NUMBER_OF_FEEDER
+#endif
+
+//bursts flushServoControllers() posts at most, and the flushes it takes to update every moving servo once
+#define I2C_FLUSH_BURSTS_MAX (I2C_MOVING_CHANNELS_MAX < I2C_QUEUE_LENGTH ? I2C_MOVING_CHANNELS_MAX : I2C_QUEUE_LENGTH)
+#define I2C_FLUSHES_PER_UPDATE ((I2C_MOVING_CHANNELS_MAX + I2C_FLUSH_BURSTS_MAX - 1) / I2C_FLUSH_BURSTS_MAX)
+
+#define I2C_FLUSH_CHANNELS_MAX (I2C_MOVING_CHANNELS_MAX < I2C_FLUSH_BURSTS_MAX * SERVO_CONTROLLER_BURST_CHANNELS ? I2C_MOVING_CHANNELS_MAX : I2C_FLUSH_BURSTS_MAX * SERVO_CONTROLLER_BURST_CHANNELS)
+
+#define I2C_FLUSH_WORST_CASE_US (((unsigned long)I2C_FLUSH_BURSTS_MAX * I2C_BURST_OVERHEAD_BITS + (unsigned long)I2C_FLUSH_CHANNELS_MAX * I2C_CHANNEL_BITS) * 1000UL / (I2C_CLOCK_HZ / 1000))
+
+//[ms] min time between servo flushes, so the worst case stays within I2C_BUS_BUDGET_PERCENT
+#define I2C_FLUSH_INTERVAL_MS (I2C_FLUSH_WORST_CASE_US * 100 / I2C_BUS_BUDGET_PERCENT / 1000 + 1)
+
+static_assert(I2C_CLOCK_HZ == 100000 || I2C_CLOCK_HZ == 400000, "I2C_CLOCK_HZ: 100000 or 400000");
+static_assert(I2C_BUS_BUDGET_PERCENT > 0 && I2C_BUS_BUDGET_PERCENT <= 100, "I2C_BUS_BUDGET_PERCENT out of range");
+static_assert(I2C_FLUSH_INTERVAL_MS * I2C_FLUSHES_PER_UPDATE <= SERVO_FRAME_MS, "moving servos can not all be updated once per servo frame: raise I2C_CLOCK_HZ, I2C_BUS_BUDGET_PERCENT or I2C_QUEUE_LENGTH, or admit less moves at once (MOTION_CURRENT_BUDGET_MA)");
+
+//true if servo changes may go on the bus at /now/ [ms]. call flushServoControllers() then
+bool i2cFlushDue(unsigned long now);
+//a flush at /now/ did write (the next one is due I2C_FLUSH_INTERVAL_MS later)
+void i2cFlushDone(unsigned long now);
+
+#ifdef LATENCY_STATS
+//account /us/ of bus time, to the servo frame running now
+void i2cBudgetRecord(unsigned long us);
+void i2cBudgetPrint();
+void i2cBudgetReset();
+#endif
+
+
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef _I2CQUEUE_h
+#define _I2CQUEUE_h
+
+#include "arduino.h"
+#include "config.h"
+
+
+/*
+*  Asynchronous I²C master: a queue of write transactions, sent one after another by the TWI interrupt.
+*  i2cQueuePost() copies the bytes and returns at once, the loop never waits for the bus. i2cQueuePostRead()
+*  adds reading after a repeated START (e.g. the register pointer is written, then the registers read). A transaction
+*  the slave does not acknowledge (NACK) or that loses the bus is sent again, up to I2C_QUEUE_RETRIES times.
+*  Its callback is called, from the interrupt, once it went out or was given up.
+*  On the host simulator the transfers go to the simulated bus and complete as virtual time passes.
+*/
+
+#define I2C_QUEUE_DATA 29		// bytes per transaction: register pointer and 7 channels of 4 bytes, as much as one burst needs
+#define I2C_GENERAL_CALL_ADDRESS 0x00
+#define I2C_QUEUE_RAM (I2C_QUEUE_LENGTH * (I2C_QUEUE_DATA + 12))	// the queue on AVR, for the RAM check in main.cpp
+
+//outcome of a transaction, for the callback
+enum eI2CResult : uint8_t {
+	I2C_RESULT_OK,
+	I2C_RESULT_FAILED,		// NACK or bus lost on every try
+};
+
+//called from the interrupt: keep it short. /tag/ is what was given to i2cQueuePost(), /us/ the time from the first START to the end
+typedef void (*I2CDoneCallback)(void *context, uint16_t tag, eI2CResult result, unsigned long us);
+
+struct sI2CQueueStats {
+	uint16_t transactions;		// sent and acknowledged
+	uint16_t nacks;				// tries not acknowledged
+	uint16_t retries;			// tries after the first
+	uint16_t failed;			// given up after I2C_QUEUE_RETRIES
+	uint16_t full;				// posts refused, queue full
+};
+
+extern volatile sI2CQueueStats i2cQueueStats;
+
+//sets up the TWI at I2C_CLOCK_HZ
+void i2cQueueBegin();
+
+//queue a write of /length/ bytes to the slave at 7 bit /address/. false if the queue is full, nothing is queued then
+bool i2cQueuePost(uint8_t address, const uint8_t *data, uint8_t length, I2CDoneCallback done = NULL, void *context = NULL, uint16_t tag = 0);
+
+//same, then read /readLength/ bytes to /readData/ (written by the interrupt, valid once the callback says OK)
+bool i2cQueuePostRead(uint8_t address, const uint8_t *data, uint8_t length, uint8_t *readData, uint8_t readLength, I2CDoneCallback done = NULL, void *context = NULL, uint16_t tag = 0);
+
+//transactions waiting or on the bus
+uint8_t i2cQueuePending();
+
+//wait until all queued transactions are done (setup only)
+void i2cQueueWait();
+
+void i2cQueuePrintStats();
+void i2cQueueResetStats();
+
+//interrupts off on AVR for the enclosed block, to share data with the callbacks
+#ifdef __AVR__
+#include <util/atomic.h>
+#define I2C_ATOMIC ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#else
+#define I2C_ATOMIC
+#endif
+
+
+
+#endif
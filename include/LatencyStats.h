@@ -0,0 +1,43 @@
+#ifndef _LATENCYSTATS_h
+#define _LATENCYSTATS_h
+
+#include "arduino.h"
+#include "config.h"
+
+#ifdef LATENCY_STATS
+
+#define LATENCY_HISTOGRAM_BUCKETS 12
+
+
+/*
+*  Durations in µs, counted in power of 2 buckets: bucket 0 is below 16 µs, bucket n below 16 << n µs,
+*  the last one takes everything above (16.4 ms and more). Counts stop at 65535. Plus the longest one seen.
+*/
+struct sLatencyHistogram {
+	uint16_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+	unsigned long max;
+};
+
+//count and longest run time of one M-code
+struct sCommandLatency {
+	int16_t code;
+	uint16_t count;
+	unsigned long max;
+};
+
+extern sLatencyHistogram loopLatency;		// loop() iterations
+extern sLatencyHistogram commandLatency;	// processCommand(), all M-codes
+extern sLatencyHistogram i2cLatency;		// I²C bursts to the PCA9685s, on the bus (recorded by the interrupt)
+extern sCommandLatency commandLatencies[LATENCY_STATS_COMMANDS];
+
+void latencyRecord(sLatencyHistogram *histogram, unsigned long us);
+void latencyRecordCommand(int16_t code, unsigned long us);
+void latencyPrint(const __FlashStringHelper *name, sLatencyHistogram *histogram);
+bool latencyPrintCommand(uint8_t i);
+void latencyResetCommands();
+
+#endif
+
+
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef _MOTIONTIMER_h
+#define _MOTIONTIMER_h
+
+#include "arduino.h"
+#include "config.h"
+
+
+/*
+*  Clock the motion engine runs on.
+*  Without MOTION_FRAME_TIMER motion is stepped every loop iteration against millis().
+*  With MOTION_FRAME_TIMER a hardware timer ticks once per servo frame (SERVO_FRAME_MS, the
+*  PCA9685 period set by setPWMFreqServo()). Motion is then stepped once per frame, against the
+*  time the tick happened, so each channel gets at most one update per frame and move timing
+*  does not depend on how long the loop took to get there.
+*/
+
+void motionTimerBegin();
+
+//true if motion has to be stepped now, /frameTime/ is the timestamp to step to
+bool motionFrameElapsed(unsigned long *frameTime);
+
+//timestamp new moves are planned from (last frame, or now without frame timer)
+unsigned long motionTime();
+
+
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef _SERIALTX_h
+#define _SERIALTX_h
+
+#include "arduino.h"
+#include "config.h"
+
+#include <HardwareSerial.h>
+
+
+/*
+*  Output side of the serial port, buffered in RAM.
+*  print()/println() only format into a ring buffer, drain() (once per loop) hands
+*  to Serial as many bytes as it accepts without blocking. So replies do not stall
+*  the motion loop while the host reads them.
+*  Only when the ring buffer itself is full, write() falls back to waiting for the port.
+*/
+class SerialTxClass : public Print {
+	protected:
+		uint8_t buffer[SERIAL_TX_BUFFER_SIZE];
+		uint8_t head = 0;		// next byte written
+		uint8_t count = 0;		// bytes waiting to be sent
+
+		void sendChunk(uint8_t maxBytes);
+
+	public:
+		#ifdef LATENCY_STATS
+		uint16_t stalls = 0;				// writes that found the ring buffer full and waited for the port
+		unsigned long stallTime = 0;		// [µs] waited in total
+		#endif
+
+		virtual size_t write(uint8_t c);
+		using Print::write;
+
+		int availableForWrite();
+		bool isEmpty();
+		void drain();
+		void flush();
+};
+
+extern SerialTxClass serialTx;
+
+
+
+#endif
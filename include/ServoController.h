@@ -0,0 +1,60 @@
+#ifndef _SERVOCONTROLLER_h
+#define _SERVOCONTROLLER_h
+
+#include "arduino.h"
+#include "config.h"
+#include "I2CQueue.h"
+
+#define SERVO_CONTROLLER_CHANNELS 16
+#define SERVO_CONTROLLER_PWM_FULL (uint16_t)0x1000		// on bit of the channel registers: full on, no pulses
+#define SERVO_CONTROLLER_BURST_CHANNELS ((I2C_QUEUE_DATA - 1) / 4)	// channels in one transaction: register pointer, then 4 bytes each
+
+
+/*
+*  One PCA9685 with a shadow copy of its channel registers.
+*  Writing a channel only updates the shadow and marks it dirty, nothing goes on the bus.
+*  flush() (once per loop) posts every run of consecutive dirty channels as auto-increment
+*  bursts to the I²C queue, up to a given number, and returns, the bursts go out from the TWI interrupt.
+*  Channels beyond that number, that find the queue full, or whose burst failed, stay dirty for the next flush.
+*  A device whose bursts fail I2C_CONTROLLER_FAILED_BURSTS times in a row (missing, unplugged) goes offline: its
+*  changes are dropped until reset, so its NACKs do not take the bus from the others. The device is set to
+*  update its outputs on STOP, so all channels of a burst change together at the start of the next PWM cycle.
+*  Channel pulses start at channel * 256 counts into the cycle, so the servos do not all draw current at once.
+*  begin() takes the state of the device's address pins A5..A0. After it all channels are off, as after a reset: a servo gets no pulses until
+*  its feeder set a position, so it does not move on power on.
+*  The reset is a general call to every device on the bus, so resetDevices() is called once, before the first begin().
+*/
+class ServoControllerClass {
+	protected:
+		uint16_t channelPWM[SERVO_CONTROLLER_CHANNELS];
+		uint16_t dirtyChannels = 0;				// bit n set: channel n changed since last flush
+		volatile uint16_t failedChannels = 0;	// bit n set: the burst with channel n failed, set by the interrupt
+		volatile uint8_t failedBursts = 0;		// failed in a row, set by the interrupt
+		volatile bool offline = false;			// failedBursts reached I2C_CONTROLLER_FAILED_BURSTS
+		bool offlineReported = false;
+		uint8_t address;						// 7 bit bus address
+
+		void writeRegister(uint8_t reg, uint8_t value);
+		static void burstDone(void *context, uint16_t tag, eI2CResult result, unsigned long us);
+
+	public:
+		#ifdef LATENCY_STATS
+		volatile uint16_t bursts = 0;			// I²C bursts written by flush()
+		volatile unsigned long burstMax = 0;	// [µs] longest one on the bus
+		#endif
+
+		static void resetDevices();
+		void begin(uint8_t address);
+		void setChannelPWM(uint8_t channel, uint16_t pwm);
+		void setChannelOn(uint8_t channel);
+		void setChannelOff(uint8_t channel);
+		bool isDirty();
+		uint8_t getAddress() { return this->address; }
+		//true once, after the device went offline
+		bool takeOfflineReport();
+		uint8_t flush(uint8_t bursts);
+};
+
+
+
+#endif
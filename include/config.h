@@ -10,6 +10,30 @@
 // uncomment to disable in production
 // #define DEBUG
 
+/*
+*     LATENCY STATS
+*/
+// histograms of loop, command, I²C and serial TX timing in RAM, reported by M632
+// cheap enough to leave enabled, comment out to compile out completely
+#define LATENCY_STATS
+#define LATENCY_STATS_COMMANDS 8		// M-codes with their own count and max time, further ones are only in the histogram
+
+// per feeder cycle statistics (advances, cycle and stroke times, errors), reported by M633. 22 bytes RAM per feeder:
+// with 32 feeders more than FEEDER_BANK_RAM_BUDGET leaves on a Teensy 2.0. uncomment for less feeders,
+// the host simulation ([env:native]) has it enabled
+// #define FEEDER_STATS
+#define FEEDER_SETTLE_OVERRUN_MS 5		// [ms] a settle time handled later than this counts as overrun
+
+/*
+*  RAM
+*/
+// the feeder objects and their motion arrays may take this much of the 2.5 kB, the rest is left to the stack, serial and I²C buffers
+// and the other globals. checked at compile time on AVR
+#define FEEDER_BANK_RAM_BUDGET 1664
+// kept free for the stack: the large globals of all modules plus this have to fit the RAM (checked at compile time on AVR),
+// scripts/ram_report.py fails the build on the linked static RAM plus the deeper of this and the measured stack
+#define RAM_STACK_RESERVE 256
+
 /*
 *  Select controller shield
 */
@@ -17,16 +41,64 @@
 //change config_version, if change shield!
 
 
+/*
+*  I²C
+*/
+// bus clock to the PCA9685s: 100000 or 400000 (fast mode, the most the ATmega32U4's TWI is specified for)
+#define I2C_CLOCK_HZ 400000
+// share of the bus time servo updates may take at worst. the rest is left for bursts of non moving channels
+// (enable, disable). servo writes are spaced to stay within it, see I2CBudget.h
+#define I2C_BUS_BUDGET_PERCENT 50
+// transactions waiting for the bus, each takes I2C_QUEUE_DATA + 12 bytes RAM. servo changes that do not fit stay
+// in the controller's shadow registers and go out with a later flush
+#define I2C_QUEUE_LENGTH 4
+#define I2C_QUEUE_RETRIES 3		// a transaction not acknowledged (NACK) or that lost the bus is sent again this often
+#define I2C_CONTROLLER_FAILED_BURSTS 8	// a PCA9685 whose bursts failed this often in a row (after the retries) is left alone until reset
+
+
+/*
+*  Feedback lines
+*/
+// tensioner microswitch of every feeder (low: cover tape tensioned), read through MCP23017 port expanders on the I²C bus:
+// feeder n is pin n%16 (GPA0..GPA7, GPB0..GPB7) of the expander with address pins A2..A0 = n/16. uncomment to enable
+// #define HAS_FEEDBACKLINES
+#define FEEDBACK_SCAN_MS 8			// [ms] all expanders are read this often, a line has to read the same 4 scans in a row to change
+#define FEEDBACK_HOLD_BITS 6		// a press longer than 2^FEEDBACK_HOLD_BITS scans (512 ms) is the cover tape put in, not a manual feed
+
+
+/*
+*  Motion timing
+*/
+// step servo motion once per servo frame from a hardware timer (Timer3) instead of every loop iteration
+// uncomment to enable. "ok" answers are then sent on frame boundaries, too.
+// #define MOTION_FRAME_TIMER
+#define SERVO_FRAME_MS 20		// [ms] PWM period of the PCA9685 at setPWMFreqServo() (50 Hz)
+#define BOOT_HOMING_TIMEOUT_MS 1000	// [ms] setup() waits for the feeders' moves to retract at most this long
+
+// admission of servo moves, to stay within what the servo supply delivers. a move that does not fit
+// waits (in feeder order) until enough moves finished. MOTION_CURRENT_BUDGET_MA / MOTION_MOVE_CURRENT_MA
+// is the number of servos moving at once, 0 for no limit
+#define MOTION_CURRENT_BUDGET_MA 4000	// [mA] available for moving servos
+#define MOTION_MOVE_CURRENT_MA 250		// [mA] drawn by one moving servo
+#ifdef MOTION_FRAME_TIMER
+#define MOTION_START_STAGGER_MS 0		// [ms] min time between two move starts. 0: moves are stepped per frame anyway
+#else
+#define MOTION_START_STAGGER_MS 2		// [ms] min time between two move starts, spreads the inrush of moves started together
+#endif
+
+
 /*
 *  EEPROM-Settings
 */
-//change to something other unique if structure of data to be saved in eeprom changed (max 3 chars)
-#define CONFIG_VERSION "zsz"
+//change to something other unique if the eeprom layout changed (max 3 chars)
+//feeder settings are records of their own, changing sFeederSettings does not need a new version (see FEEDER_SETTINGS_SCHEMA)
+#define CONFIG_VERSION "rc1"
 
 /*
 *  Serial
 */
 #define SERIAL_BAUD 115200
+#define SERIAL_TX_BUFFER_SIZE 128		// replies are formatted into this ring buffer and sent as the port takes them, power of 2
 
 
 /* -----------------------------------------------------------------
@@ -108,6 +180,8 @@
 #define FEEDER_DEFAULT_TIME_TO_SETTLE  30			  // [ms] time the servo needs to travel from FEEDER_DEFAULT_FULL_ADVANCED_ANGLE to FEEDER_DEFAULT_RETRACT_ANGLE (type: uint8_t -> max 255ms)
 #define FEEDER_DEFAULT_ADVANCE_ANGLE_SPEED 64		// max speed
 #define FEEDER_DEFAULT_RETRACT_ANGLE_SPEED 128		// max speed
+#define FEEDER_DEFAULT_ADVANCE_ANGLE_ACCELERATION 0	// [1/4096 °/ms²] 0: start and stop at full speed
+#define FEEDER_DEFAULT_RETRACT_ANGLE_ACCELERATION 0	// [1/4096 °/ms²] 0: start and stop at full speed
 /* Added 40 degrees for all angles for "0816 Feeder Redesigned */
 #define FEEDER_DEFAULT_RD_FULL_ADVANCED_ANGLE  130		// [°]  usually 130 (type: uint8_t)
 #define FEEDER_DEFAULT_RD_HALF_ADVANCED_ANGLE  84		// [°]  exact math would be 83.85. may need tweaking. only needed if advancing half pitch (for 0401 smds) (type: uint8_t)
@@ -120,8 +194,11 @@
 */
 #define FEEDER_DEFAULT_MOTOR_MIN_PULSEWIDTH 100		// [µs] see motor specs or experiment at bit. Value set here should bring the servo to 0°
 #define FEEDER_DEFAULT_MOTOR_MAX_PULSEWITH 600		// [µs] see motor specs or experiment at bit. Value set here should bring the servo to 180°
+#define FEEDER_ADVANCE_QUEUE_BATCH 0x80	// flag in queued feed lengths (max 24mm)
+#define FEEDER_ADVANCE_QUEUE_LENGTH 6		// advance commands a busy feeder accepts and processes one after another, each answered with its own ok
 #define FEEDER_DEFAULT_IGNORE_FEEDBACK 1			// 0: before feeding the feedback-signal is checked. if signal is as expected, the feeder advances tape and returns OK to host. otherwise an error is thrown.
 													// 1: the feedback-signal is not checked, feeder advances tape and returns OK always
+#define FEEDER_DEFAULT_PREFEED 0					// 1: M601 retracts and at once feeds the next part, the following M600 answers without waiting for a full cycle
 
 
 
@@ -138,8 +215,33 @@
 
 #define EEPROM_FEEDER_SETTINGS_ADDRESS_OFFSET 16
 
+//feeder settings record: schema, length of the settings, the settings, crc8. one fixed slot per feeder with room for fields to come
+#define FEEDER_SETTINGS_SCHEMA 1				// bump only if existing fields change meaning. appended fields are covered by the length
+#define FEEDER_SETTINGS_RECORD_SLOT 28			// [bytes] per feeder in eeprom
+
+//last lever position per feeder (sFeederPosition), restored on start. written only if it changed, once a feeder is disabled,
+//unloaded or back at retract for FEEDER_POSITION_PERSIST_IDLE_MS: at most twice per M610 S0 or M603 (there and back to retract),
+//never while picking. 100k writes per cell
+#define EEPROM_FEEDER_POSITION_ADDRESS_OFFSET (EEPROM_FEEDER_SETTINGS_ADDRESS_OFFSET + NUMBER_OF_FEEDER * FEEDER_SETTINGS_RECORD_SLOT)
+#define FEEDER_POSITION_PERSIST_IDLE_MS 60000	// [ms] below 65536
+
+//layouts before records (plain sFeederSettings per feeder), migrated on first start: version and size per feeder
+#define EEPROM_LEGACY_VERSION_SPEED "zsz"
+#define EEPROM_LEGACY_SIZE_SPEED 14
+#define EEPROM_LEGACY_VERSION_ACCELERATION "zta"
+#define EEPROM_LEGACY_SIZE_ACCELERATION 18
+
+//changed feeder settings are written behind, one byte per loop iteration at most. bytes of the eeprom copy compared per iteration
+#define SETTINGS_JOURNAL_COMPARES_PER_STEP 8
+
 //buffer size for serial commands received
-#define MAX_BUFFFER_MCODE_LINE 64	// no line can be longer than this
+#define MAX_BUFFFER_MCODE_LINE 96	// no line can be longer than this
+#define MAX_GCODE_PARAMETERS 12		// letter/value pairs kept per line, further ones are ignored
+
+//parameter values are parsed to fixed point integers, no floats involved
+#define GCODE_FIXED_POINT_DECIMALS 4
+#define GCODE_FIXED_POINT_SCALE 10000L		// 10^GCODE_FIXED_POINT_DECIMALS
+#define GCODE_MAX_INTEGER_PART 10000L		// further integer digits are ignored (max. 99999), keeps value*scale in int32_t
 
 //to calculate how often advancing has to be repeated if commanded to advance more than 4 millimeter per feed
 #define FEEDER_MECHANICAL_ADVANCE_LENGTH  4                   // [mm]  default: 4 mm. fixed as per mechanical design.
@@ -154,11 +256,16 @@
 #define MCODE_FEEDER_IS_OK 602
 #define MCODE_SERVO_SET_ANGLE 603
 #define MCODE_UNLOAD 604
+#define MCODE_ADVANCE_BATCH 605
 #define MCODE_SET_FEEDER_ENABLE 610
 #define MCODE_UPDATE_FEEDER_CONFIG	620
 #define MCODE_UPDATE_ALL_FEEDER_CONFIG	621
 #define MCODE_UPDATE_ALL_FEEDERS_RD  622
+#define MCODE_COMMIT_FEEDER_CONFIG  623
 #define MCODE_PRINT_FEEDER_CONFIG  630
+#define MCODE_MOTION_ADMISSION_STATS  631
+#define MCODE_LATENCY_STATS  632
+#define MCODE_FEEDER_STATS  633
 
 #define MCODE_GET_ADC_RAW 143
 #define MCODE_GET_ADC_SCALED 144
@@ -0,0 +1,38 @@
+#ifndef _GCODE_h
+#define _GCODE_h
+
+#include "arduino.h"
+#include "config.h"
+
+
+/*
+*  G-code line parser. listenToSerialStream() collects a line in inputBuffer, parseGCodeLine() splits it
+*  into letter/value pairs once, the commands then look their parameters up by letter.
+*/
+
+#define GCODE_PARAMETERS_RAM (MAX_GCODE_PARAMETERS * 6)	// the parsed parameters on AVR, for the RAM check in main.cpp
+
+extern char inputBuffer[MAX_BUFFFER_MCODE_LINE];	// Buffer for incoming G-Code lines
+extern uint8_t inputBufferLength;
+extern bool inputBufferOverflow;					// line exceeded the buffer, rest of it is dropped
+
+// read position in a list parameter, see beginParameterList()
+struct sGCodeList {
+	uint8_t position;	// next char in inputBuffer
+	int16_t next;		// next value of a range in progress
+	int16_t last;		// last value of that range
+};
+
+void setupGCodeProc();
+void parseGCodeLine();
+bool findParameter(char code, int32_t *value);
+int32_t parseParameter(char code, int32_t defaultVal);
+bool beginParameterList(char code, sGCodeList *list);
+bool nextParameterListValue(sGCodeList *list, int16_t *value);
+uint16_t parseRateParameter(char code, uint16_t oldValue, uint32_t resolution);
+uint16_t parseSpeedParameter(char code, uint16_t oldValue);
+uint16_t parseAccelerationParameter(char code, uint16_t oldValue);
+
+
+
+#endif
@@ -1,8 +1,36 @@
 #ifndef _SHIELD_h
 #define _SHIELD_h
 
+#include <stdint.h>
+
+#ifndef NUMBER_OF_FEEDER
 #define NUMBER_OF_FEEDER 32
-#define NUMBER_OF_CONTROLLERS ((uint8_t) ceil((double) NUMBER_OF_FEEDER / 16.0))
+#endif
+
+//feeders are numbered through the PCA9685 controllers: feeder n is channel n%16 of controller n/16
+#define FEEDERS_PER_CONTROLLER 16
+#define NUMBER_OF_CONTROLLERS ((NUMBER_OF_FEEDER + FEEDERS_PER_CONTROLLER - 1) / FEEDERS_PER_CONTROLLER)
+
+//address pins A5..A0 of each controller, in feeder order (bus address is 0x40 + these bits).
+//without a list the controllers are addressed 0, 1, 2, ...
+// #define CONTROLLER_ADDRESSES { 0x00, 0x01 }
+
+//feeder -> (controller, channel). integer constants of a power of 2: a shift and a mask, no division
+constexpr uint8_t feederController(uint16_t feederNo) {
+	return feederNo / FEEDERS_PER_CONTROLLER;
+}
+
+constexpr uint8_t feederChannel(uint16_t feederNo) {
+	return feederNo % FEEDERS_PER_CONTROLLER;
+}
+
+static_assert((FEEDERS_PER_CONTROLLER & (FEEDERS_PER_CONTROLLER - 1)) == 0, "FEEDERS_PER_CONTROLLER has to be a power of 2");
+static_assert(NUMBER_OF_FEEDER > 0 && NUMBER_OF_CONTROLLERS <= 55, "a PCA9685 bus has room for 55 controllers: 0x40..0x77 without the All Call address 0x70");
+static_assert(feederController(NUMBER_OF_FEEDER - 1) == NUMBER_OF_CONTROLLERS - 1, "feeder to controller mapping out of range");
+
+//feedback lines (HAS_FEEDBACKLINES): feeder n is pin n%16 of MCP23017 port expander n/16, address pins A2..A0 = n/16
+#define FEEDBACK_LINES_PER_EXPANDER 16
+#define NUMBER_OF_EXPANDERS ((NUMBER_OF_FEEDER + FEEDBACK_LINES_PER_EXPANDER - 1) / FEEDBACK_LINES_PER_EXPANDER)
 
 //DEFINE _SHIELD_h-ENDIF!!!
 #endif
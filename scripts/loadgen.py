@@ -0,0 +1,218 @@
+"""
+Load generator: replays a job on a feeder controller (the twin's pty or the real one) and reports
+the latency distribution from sending a command to its answer, per command.
+
+Like OpenPnP, every command is sent once the answer of the one before is in: M600 is answered
+with "ok, advancing cycle completed" when the tape was advanced, M601 and the others at once.
+
+Job file, one command per line, '#' starts a comment. A line may start with the time in ms since
+the start of the job it was sent at (e.g. from a recorded OpenPnP log): the command is not sent
+earlier, scaled by --speed. Without times, commands follow each other as fast as answered.
+    1520.3 M600 N3 F4
+    1733.0 M601 N3
+
+usage: python3 scripts/loadgen.py port job [--baud 115200] [--speed 1] [--timeout 10] [--repeat 1] [--json]
+       python3 scripts/loadgen.py port --synthetic 200 [--feeders 32]
+    --synthetic N   no job file: N picks, M600 to a random feeder and the M601 of the feeder picked before
+"""
+
+import json
+import os
+import random
+import re
+import select
+import sys
+import termios
+import time
+
+BAUD_RATES = {9600: termios.B9600, 19200: termios.B19200, 38400: termios.B38400, 57600: termios.B57600,
+			  115200: termios.B115200, 230400: termios.B230400}
+
+TIMED_LINE_RE = re.compile(r"^\s*(\d+(?:\.\d*)?)\s+(\S.*)$")
+
+
+class Port:
+	def __init__(self, path, baud):
+		self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+		attributes = termios.tcgetattr(self.fd)
+		#raw: cflag CS8 | CREAD | CLOCAL, no echo, no translation, read returns what is there
+		attributes[0] = 0
+		attributes[1] = 0
+		attributes[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+		attributes[3] = 0
+		attributes[4] = attributes[5] = BAUD_RATES.get(baud, termios.B115200)
+		attributes[6][termios.VMIN] = 0
+		attributes[6][termios.VTIME] = 0
+		termios.tcsetattr(self.fd, termios.TCSANOW, attributes)
+		self.buffer = b""
+
+	def drain(self, seconds):
+		"""drop what the controller sends until it was quiet for /seconds/ (boot messages, settings dump)"""
+		while self.read_line(seconds) is not None:
+			pass
+		self.buffer = b""
+
+	def send(self, line):
+		os.write(self.fd, (line + "\n").encode())
+
+	def read_answer(self, timeout):
+		"""next "ok"/"error" line, None on timeout. anything else (debug output) is no answer"""
+		end = time.monotonic() + timeout
+		while True:
+			line = self.read_line(end - time.monotonic())
+			if line is None or line.startswith("ok") or line.startswith("error"):
+				return line
+
+	def read_line(self, timeout):
+		"""next line without line end, None on timeout"""
+		end = time.monotonic() + timeout
+		while b"\n" not in self.buffer:
+			left = end - time.monotonic()
+			if left <= 0 or not select.select([self.fd], [], [], left)[0]:
+				return None
+			self.buffer += os.read(self.fd, 4096)
+		line, self.buffer = self.buffer.split(b"\n", 1)
+		return line.decode(errors="replace").strip()
+
+
+def read_job(path):
+	"""[(time in ms or None, command)]"""
+	job = []
+	with open(path) as f:
+		for line in f:
+			line = line.split("#", 1)[0].strip()
+			if not line:
+				continue
+			timed = TIMED_LINE_RE.match(line)
+			job.append((float(timed.group(1)), timed.group(2)) if timed else (None, line))
+	return job
+
+
+def synthetic_job(picks, feeders):
+	job = []
+	picked = None
+	generator = random.Random(12345)
+	for _ in range(picks):
+		feeder = generator.randrange(feeders)
+		job.append((None, "M600 N%d" % feeder))
+		if picked is not None:
+			job.append((None, "M601 N%d" % picked))
+		picked = feeder
+	return job
+
+
+def percentile(values, fraction):
+	"""nearest rank on sorted values"""
+	return values[min(len(values) - 1, max(0, int(round(fraction * len(values) + 0.5)) - 1))]
+
+
+def summary(latencies):
+	values = sorted(latencies)
+	return {
+		"count": len(values),
+		"min_ms": values[0],
+		"p50_ms": percentile(values, 0.50),
+		"p90_ms": percentile(values, 0.90),
+		"p99_ms": percentile(values, 0.99),
+		"max_ms": values[-1],
+		"mean_ms": sum(values) / len(values),
+	}
+
+
+def histogram(latencies, width=40):
+	"""text histogram, log2 buckets of ms"""
+	buckets = {}
+	for latency in latencies:
+		bucket = 0
+		while (1 << bucket) < latency:
+			bucket += 1
+		buckets[bucket] = buckets.get(bucket, 0) + 1
+	most = max(buckets.values())
+	lines = []
+	for bucket in range(min(buckets), max(buckets) + 1):
+		count = buckets.get(bucket, 0)
+		lines.append("  <= %6d ms %6d %s" % (1 << bucket, count, "#" * ((count * width + most - 1) // most)))
+	return lines
+
+
+def run(port, job, speed, timeout):
+	"""per command code: latencies in ms of answered commands, errors and timeouts"""
+	results = {}
+	start = time.monotonic()
+	for at, command in job:
+		if at is not None:
+			wait = start + at / 1000.0 / speed - time.monotonic()
+			if wait > 0:
+				time.sleep(wait)
+
+		result = results.setdefault(command.split()[0].upper(), {"latencies": [], "errors": [], "timeouts": 0})
+		sent = time.monotonic()
+		port.send(command)
+		answer = port.read_answer(timeout)
+		if answer is None:
+			result["timeouts"] += 1
+			print("timeout: %s" % command, file=sys.stderr)
+		elif answer.startswith("ok"):
+			result["latencies"].append((time.monotonic() - sent) * 1000)
+		else:
+			result["errors"].append("%s: %s" % (command, answer))
+	return results
+
+
+def main():
+	args = sys.argv[1:]
+	options = {}
+	flags = set()
+	positional = []
+	i = 0
+	while i < len(args):
+		if args[i] == "--json":
+			flags.add("json")
+		elif args[i].startswith("--") and i + 1 < len(args):
+			options[args[i][2:]] = args[i + 1]
+			i += 1
+		else:
+			positional.append(args[i])
+		i += 1
+
+	if not positional or (len(positional) < 2 and "synthetic" not in options):
+		sys.exit(__doc__)
+
+	if "synthetic" in options:
+		job = synthetic_job(int(options["synthetic"]), int(options.get("feeders", 32)))
+	else:
+		job = read_job(positional[1])
+	#repeated timed jobs run one after another
+	length = max([at for at, _ in job if at is not None] or [0])
+	job = [(None if at is None else at + length * i, command) for i in range(int(options.get("repeat", 1))) for at, command in job]
+
+	port = Port(positional[0], int(options.get("baud", 115200)))
+	port.drain(1.0)
+	#feeders have to be enabled before they advance
+	port.send("M610 S1")
+	if port.read_answer(10.0) is None:
+		sys.exit("no answer from %s" % positional[0])
+
+	results = run(port, job, float(options.get("speed", 1)), float(options.get("timeout", 10)))
+
+	for code in sorted(results):
+		result = results[code]
+		if "json" in flags:
+			line = {"command": code, "errors": len(result["errors"]), "timeouts": result["timeouts"]}
+			if result["latencies"]:
+				line.update(summary(result["latencies"]))
+			print(json.dumps(line))
+			continue
+
+		print("%s: %d ok, %d errors, %d timeouts" % (code, len(result["latencies"]), len(result["errors"]), result["timeouts"]))
+		if result["latencies"]:
+			print("  min %(min_ms).1f  p50 %(p50_ms).1f  p90 %(p90_ms).1f  p99 %(p99_ms).1f  max %(max_ms).1f  mean %(mean_ms).1f ms" % summary(result["latencies"]))
+			print("\n".join(histogram(result["latencies"])))
+		for error in result["errors"][:5]:
+			print("  %s" % error)
+
+	return 1 if any(r["errors"] or r["timeouts"] for r in results.values()) else 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())
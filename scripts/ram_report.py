@@ -0,0 +1,182 @@
+"""
+RAM report: static RAM (.data + .bss + .noinit) and the worst case stack depth of the firmware.
+
+The stack depth is the deepest call chain from main() (setup() and loop() on the host), plus the
+deepest interrupt handler on top of it. Frame sizes come from the .su files written by gcc with
+-fstack-usage, the call graph from the disassembly. Calls through pointers, recursion, dynamic
+frames (alloca, VLAs) and functions without a .su entry (libc, assembly) are listed: the depth
+does not account for them. As these can go deeper, at least RAM_STACK_RESERVE from config.h is kept for the stack.
+The build fails when the static RAM and the stack do not fit the RAM.
+
+PlatformIO: extra_scripts = pre:scripts/ram_report.py (pre: -fstack-usage has to reach all sources), reported after every build.
+Stand-alone: python3 scripts/ram_report.py firmware.elf build_dir [--tools avr-] [--ram 2560] [--reserve bytes], exit code 1 if it does not fit
+"""
+
+import os
+import re
+import subprocess
+import sys
+
+AVR_RAM_SIZE = 2560				# ATmega32U4 (Teensy 2.0)
+AVR_RETURN_ADDRESS = 2			# bytes pushed by call/rcall, devices up to 128 kB flash
+
+CALL_RE = re.compile(r"\s(?:call|rcall|jmp|rjmp|callq|jmpq)\s.*<(.+?)(?:\+0x[0-9a-f]+)?>\s*$")
+INDIRECT_RE = re.compile(r"\s(?:icall|eicall|ijmp|eijmp)\b|\s(?:call|callq|jmp|jmpq)\s+\*")
+FUNCTION_RE = re.compile(r"^[0-9a-f]+ <(.+)>:$")
+RESERVE_RE = re.compile(r"^#define\s+RAM_STACK_RESERVE\s+(\d+)", re.MULTILINE)
+
+
+def function_key(name):
+	"""Function name without return type and parameters, as both .su files and objdump -C print it differently."""
+	name = name.split("(")[0].strip()
+	return name.split(" ")[-1]
+
+
+def run(command):
+	return subprocess.run(command, check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+
+
+def static_ram(size_tool, elf):
+	sections = {}
+	for line in run([size_tool, "-A", elf]).splitlines():
+		fields = line.split()
+		if len(fields) >= 2 and fields[0] in (".data", ".bss", ".noinit") and fields[1].isdigit():
+			sections[fields[0]] = int(fields[1])
+	return sections
+
+
+def stack_reserve(include_dir):
+	"""RAM_STACK_RESERVE from config.h, 0 if there is none"""
+	try:
+		with open(os.path.join(include_dir, "config.h")) as config:
+			found = RESERVE_RE.search(config.read())
+	except OSError:
+		return 0
+	return int(found.group(1)) if found else 0
+
+
+def stack_frames(build_dir):
+	frames = {}
+	dynamic = set()
+	for root, _, files in os.walk(build_dir):
+		for file in files:
+			if not file.endswith(".su"):
+				continue
+			with open(os.path.join(root, file)) as su:
+				for line in su:
+					fields = line.rstrip("\n").split("\t")
+					if len(fields) < 3:
+						continue
+					key = function_key(fields[0].split(":", 3)[-1])
+					frames[key] = max(frames.get(key, 0), int(fields[1]))
+					if "dynamic" in fields[2] and "bounded" not in fields[2]:
+						dynamic.add(key)
+	return frames, dynamic
+
+
+def call_graph(objdump_tool, elf):
+	calls = {}
+	indirect = set()
+	function = None
+	for line in run([objdump_tool, "-d", "-C", elf]).splitlines():
+		header = FUNCTION_RE.match(line)
+		if header:
+			function = function_key(header.group(1))
+			calls.setdefault(function, set())
+			continue
+		if function is None:
+			continue
+		call = CALL_RE.search(line)
+		if call:
+			callee = function_key(call.group(1))
+			if callee != function:
+				calls[function].add(callee)
+		elif INDIRECT_RE.search(line):
+			indirect.add(function)
+	return calls, indirect
+
+
+def deepest(function, calls, frames, return_address, unknown, recursive, memo, path=()):
+	"""(depth, call chain) of the deepest chain starting at function"""
+	if function in memo:
+		return memo[function]
+	if function in path:
+		recursive.add(function)
+		return (0, [])
+	if function not in frames:
+		unknown.add(function)
+
+	best = (0, [])
+	for callee in calls.get(function, ()):
+		depth, chain = deepest(callee, calls, frames, return_address, unknown, recursive, memo, path + (function,))
+		depth += return_address
+		if depth > best[0]:
+			best = (depth, chain)
+
+	memo[function] = (frames.get(function, 0) + best[0], [function] + best[1])
+	return memo[function]
+
+
+def report(elf, build_dir, tools="", ram_size=AVR_RAM_SIZE, return_address=AVR_RETURN_ADDRESS, reserve=0):
+	sections = static_ram(tools + "size", elf)
+	frames, dynamic = stack_frames(build_dir)
+	calls, indirect = call_graph(tools + "objdump", elf)
+
+	unknown = set()
+	recursive = set()
+	memo = {}
+	roots = ["main"] if "main" in calls and any(f in frames for f in ("setup", "loop")) else ["setup", "loop"]
+	main_depth, main_chain = max((deepest(r, calls, frames, return_address, unknown, recursive, memo) for r in roots), key=lambda d: d[0])
+	isr_depth, isr_chain = max([deepest(f, calls, frames, return_address, unknown, recursive, memo) for f in calls if f.startswith("__vector_")] or [(0, [])], key=lambda d: d[0])
+	#an interrupt pushes its return address, the handler saves the registers it uses within its frame
+	stack = main_depth + (isr_depth + return_address if isr_chain else 0)
+	static = sum(sections.values())
+
+	reached = set(memo)
+	print("RAM report for %s" % elf)
+	print("  static:     %5d bytes (%s)" % (static, ", ".join("%s %d" % s for s in sorted(sections.items()))))
+	print("  stack:      %5d bytes worst case: %s" % (main_depth, " > ".join(main_chain)))
+	if isr_chain:
+		print("  interrupt: +%5d bytes: %s" % (isr_depth + return_address, " > ".join(isr_chain)))
+	if reserve > stack:
+		print("  reserved:   %5d bytes for the stack (RAM_STACK_RESERVE)" % reserve)
+	stack = max(stack, reserve)
+	if ram_size:
+		print("  free:       %5d of %d bytes" % (ram_size - static - stack, ram_size))
+	for title, functions in (("calls through pointers", indirect), ("recursion", recursive),
+							 ("dynamic frames", dynamic), ("no stack usage known", unknown)):
+		functions = sorted(functions & reached)
+		if functions:
+			print("  not counted, %s: %s" % (title, ", ".join(functions)))
+
+	return ram_size - static - stack if ram_size else 0
+
+
+try:
+	Import("env")		# run by PlatformIO
+except NameError:
+	env = None
+
+if env is not None:
+	env.Append(CCFLAGS=["-fstack-usage"])
+
+	def ram_report(target, source, env):
+		#avr-gcc -> avr-size, avr-objdump
+		cc = env.subst("$CC")
+		tools = os.path.join(os.path.dirname(cc), os.path.basename(cc)[:-len("gcc")])
+		free = report(str(target[0]), env.subst("$BUILD_DIR"), tools, reserve=stack_reserve(env.subst("$PROJECT_INCLUDE_DIR")))
+		if free < 0:
+			print("Error: static RAM and stack are %d bytes more than the RAM" % -free)
+			return 1		# fails the build
+
+	env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", ram_report)
+
+elif __name__ == "__main__":
+	if len(sys.argv) < 3:
+		sys.exit(__doc__)
+	args = sys.argv[3:]
+	tools = args[args.index("--tools") + 1] if "--tools" in args else "avr-"
+	ram = int(args[args.index("--ram") + 1]) if "--ram" in args else AVR_RAM_SIZE
+	return_address = int(args[args.index("--return-address") + 1]) if "--return-address" in args else AVR_RETURN_ADDRESS
+	reserve = int(args[args.index("--reserve") + 1]) if "--reserve" in args else stack_reserve(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "include"))
+	sys.exit(1 if report(sys.argv[1], sys.argv[2], tools, ram, return_address, reserve) < 0 else 0)
@@ -0,0 +1,92 @@
+#ifndef _SIM_EEPROMEX_h
+#define _SIM_EEPROMEX_h
+
+#include "arduino.h"
+
+/*
+*  Stand-in for thijse/EEPROMEx. The cells live in RAM (optionally loaded from
+*  and saved to an image file by the simulator). Like on the AVR, programming a
+*  cell runs in the background for the cell write time: isReady() is false until
+*  it is done, and any access meanwhile waits (advances the virtual clock), so
+*  blocking writes show up in loop timing just like on the controller.
+*  Like the library, every write, update or block call counts against the allowed
+*  writes (100 unless setMaxAllowedWrites() says otherwise, an int as on the AVR):
+*  past them the call is refused and "Exceeded maximum number of writes" printed.
+*/
+
+#ifndef SIM_EEPROM_SIZE
+#define SIM_EEPROM_SIZE 1024			// Teensy 2.0 / ATmega32U4
+#endif
+#define SIM_EEPROM_WRITE_TIME_US 3300	// erase + write of one cell
+
+class EEPROMClassEx {
+	public:
+		EEPROMClassEx();
+
+		bool isReady();
+		bool isReadOk(int address) { return address >= 0 && address < SIM_EEPROM_SIZE; }
+		bool isWriteOk(int address);
+		void setMaxAllowedWrites(int allowedWrites) { this->allowedWrites = allowedWrites; }
+
+		uint8_t read(int address);
+		uint8_t readByte(int address) { return read(address); }
+		bool write(int address, uint8_t value);
+		bool writeByte(int address, uint8_t value) { return write(address, value); }
+		bool update(int address, uint8_t value);
+		bool updateByte(int address, uint8_t value) { return update(address, value); }
+
+		template <class T> int readBlock(int address, const T &value) {
+			return readBlock(address, &value, 1);
+		}
+		template <class T> int readBlock(int address, const T value[], int items) {
+			unsigned int bytes = items * sizeof(T);
+			if (!isReadOk(address + bytes - 1)) return 0;
+			uint8_t *dst = (uint8_t *)(void *)value;
+			for (unsigned int i = 0; i < bytes; i++)
+				dst[i] = read(address + i);
+			return bytes;
+		}
+
+		template <class T> int writeBlock(int address, const T &value) {
+			return writeBlock(address, &value, 1);
+		}
+		template <class T> int writeBlock(int address, const T value[], int items) {
+			unsigned int bytes = items * sizeof(T);
+			if (!isWriteOk(address + bytes - 1)) return 0;
+			const uint8_t *src = (const uint8_t *)(const void *)value;
+			for (unsigned int i = 0; i < bytes; i++)
+				program(address + i, src[i]);
+			return bytes;
+		}
+
+		template <class T> int updateBlock(int address, const T &value) {
+			return updateBlock(address, &value, 1);
+		}
+		template <class T> int updateBlock(int address, const T value[], int items) {
+			unsigned int bytes = items * sizeof(T);
+			if (!isWriteOk(address + bytes - 1)) return 0;
+			const uint8_t *src = (const uint8_t *)(const void *)value;
+			int written = 0;
+			for (unsigned int i = 0; i < bytes; i++) {
+				if (read(address + i) != src[i]) {
+					program(address + i, src[i]);
+					written++;
+				}
+			}
+			return written;
+		}
+
+		// simulator access to the raw cells
+		uint8_t cells[SIM_EEPROM_SIZE];
+
+	private:
+		int16_t allowedWrites = 100;
+		int16_t writeCounts = 0;		// wraps like the library's int on the AVR
+
+		void waitReady();
+		void program(int address, uint8_t value);
+};
+
+extern EEPROMClassEx EEPROM;
+
+#endif
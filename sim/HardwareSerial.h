@@ -0,0 +1,31 @@
+#ifndef _SIM_HARDWARESERIAL_h
+#define _SIM_HARDWARESERIAL_h
+
+#include "Print.h"
+
+#define SIM_SERIAL_TX_FIFO_SIZE 64
+
+/*
+*  Serial port stand-in. RX bytes are queued by the simulator driver,
+*  every TX byte is counted and handed to the simulator log.
+*  TX goes through a 64 byte FIFO that drains at the baud rate given to begin()
+*  (10 bits per byte). write() on a full FIFO blocks, i.e. advances the virtual
+*  clock until a byte left, like the real core does.
+*/
+class HardwareSerial : public Print {
+	public:
+		void begin(unsigned long baud);
+		void end() {}
+		int available();
+		int peek();
+		int read();
+		int availableForWrite();
+		void flush() {}
+		size_t write(uint8_t c);
+		using Print::write;
+		operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,48 @@
+#include "MCP23017.h"
+#include "Sim.h"
+
+#define MCP23017_REGISTERS 0x16
+
+namespace sim {
+
+	struct MCP23017Device {
+		uint8_t registers[MCP23017_REGISTERS];
+		uint16_t low;		// pins pulled low from outside, bit n: GPA0..GPA7, GPB0..GPB7
+	};
+
+	static MCP23017Device expanders[MCP23017_DEVICES];
+
+	void setExpanderPin(uint8_t address, uint8_t pin, bool level) {
+		if (address < MCP23017_I2C_BASE_ADDRESS || address >= MCP23017_I2C_BASE_ADDRESS + MCP23017_DEVICES || pin >= 16)
+			return;
+		MCP23017Device &device = expanders[address - MCP23017_I2C_BASE_ADDRESS];
+		if (level)
+			device.low &= ~((uint16_t)1 << pin);
+		else
+			device.low |= (uint16_t)1 << pin;
+	}
+
+	static uint8_t readRegister(const MCP23017Device &device, uint8_t reg) {
+		if (reg == MCP23017_GPIOA_REG)
+			return ~device.low & 0xFF;
+		if (reg == MCP23017_GPIOA_REG + 1)
+			return ~device.low >> 8;
+		return device.registers[reg];
+	}
+
+	bool mcp23017Transfer(uint8_t address, const uint8_t *data, uint8_t length, uint8_t *readData, uint8_t readLength) {
+		MCP23017Device &device = expanders[address - MCP23017_I2C_BASE_ADDRESS];
+
+		// first byte written is the register pointer, it advances with every byte and wraps after the last register
+		uint8_t reg = length > 0 ? data[0] % MCP23017_REGISTERS : 0;
+		for (uint8_t i = 1; i < length; i++) {
+			device.registers[reg] = data[i];
+			reg = (reg + 1) % MCP23017_REGISTERS;
+		}
+		for (uint8_t i = 0; i < readLength; i++) {
+			readData[i] = readRegister(device, reg);
+			reg = (reg + 1) % MCP23017_REGISTERS;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,20 @@
+#ifndef _SIM_MCP23017_h
+#define _SIM_MCP23017_h
+
+#include "arduino.h"
+
+/*
+*  MCP23017 port expanders on the simulated I²C bus, at 0x20..0x27. Register writes and reads
+*  with the pointer advancing (IOCON.BANK = 0, SEQOP = 0, the power on setting). Every pin reads
+*  high, as with its pull-up on, unless the simulator pulls it low (setExpanderPin()).
+*/
+
+#define MCP23017_I2C_BASE_ADDRESS 0x20
+#define MCP23017_DEVICES 8
+#define MCP23017_GPIOA_REG 0x12
+
+namespace sim {
+	bool mcp23017Transfer(uint8_t address, const uint8_t *data, uint8_t length, uint8_t *readData, uint8_t readLength);
+}
+
+#endif
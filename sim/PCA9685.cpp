@@ -0,0 +1,79 @@
+#include "PCA9685.h"
+#include "Sim.h"
+
+#include <map>
+
+namespace sim {
+
+	struct PCA9685Device {
+		uint8_t registers[256];
+	};
+
+	static std::map<uint8_t, PCA9685Device> devices;		// by 7 bit bus address, created on first access
+
+	// power on and SWRST state: sleeping, All Call on, every channel full off
+	static void resetDevice(PCA9685Device &device) {
+		memset(device.registers, 0, sizeof(device.registers));
+		device.registers[PCA9685_MODE1_REG] = 0x11;
+		device.registers[PCA9685_MODE1_REG + 1] = 0x04;
+		for (uint8_t i = 0; i < PCA9685_CHANNEL_COUNT; i++)
+			device.registers[PCA9685_LED0_REG + 4 * i + 3] = 0x10;
+		device.registers[PCA9685_PRESCALE_REG] = 0x1E;
+	}
+
+	// pulse of the ON/OFF registers at /reg/: 0 for full off, PCA9685_PWM_FULL for full on, else the high time in counts
+	static uint16_t channelPWM(const uint8_t *reg) {
+		uint16_t on = reg[0] | (uint16_t)reg[1] << 8;
+		uint16_t off = reg[2] | (uint16_t)reg[3] << 8;
+		if (off & PCA9685_PWM_FULL)
+			return 0;
+		if (on & PCA9685_PWM_FULL)
+			return PCA9685_PWM_FULL;
+		return (off - on) & (PCA9685_PWM_FULL - 1);
+	}
+
+	bool pca9685Write(uint8_t address, const uint8_t *data, uint8_t length) {
+		if (address == 0) {
+			if (length == 1 && data[0] == PCA9685_SW_RESET) {
+				for (std::map<uint8_t, PCA9685Device>::iterator it = devices.begin(); it != devices.end(); ++it)
+					resetDevice(it->second);
+			}
+			return true;
+		}
+
+		if (address < PCA9685_I2C_BASE_MODULE_ADDRESS || address > 0x7F)
+			return false;
+
+		std::map<uint8_t, PCA9685Device>::iterator it = devices.find(address);
+		if (it == devices.end()) {
+			it = devices.insert(std::make_pair(address, PCA9685Device())).first;
+			resetDevice(it->second);
+		}
+		PCA9685Device &device = it->second;
+
+		if (length == 0)
+			return true;
+
+		// first byte is the register pointer, then data with auto-increment if MODE1 has it on
+		uint8_t reg = data[0];
+		for (uint8_t i = 1; i < length; i++) {
+			device.registers[reg] = data[i];
+
+			if (reg >= PCA9685_LED0_REG && reg < PCA9685_LED0_REG + 4 * PCA9685_CHANNEL_COUNT) {
+				uint8_t channel = (reg - PCA9685_LED0_REG) / 4;
+				if ((reg - PCA9685_LED0_REG) % 4 == 3) {
+					counters.channelWrites++;
+					logPWM(address, channel, channelPWM(&device.registers[PCA9685_LED0_REG + 4 * channel]));
+				}
+			} else if (reg == PCA9685_ALLLED_REG + 3) {
+				logPWM(address, -1, channelPWM(&device.registers[PCA9685_ALLLED_REG]));
+			} else if (reg >= PCA9685_LED0_REG + 4 * PCA9685_CHANNEL_COUNT && reg < PCA9685_ALLLED_REG) {
+				counters.invalidChannelWrites++;
+			}
+
+			if (device.registers[PCA9685_MODE1_REG] & PCA9685_MODE1_AUTOINC)
+				reg++;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef _SIM_PCA9685_h
+#define _SIM_PCA9685_h
+
+#include "arduino.h"
+
+/*
+*  PCA9685 devices on the simulated I²C bus. Every address from 0x40 answers like a
+*  PCA9685 with its address pins set that way: register writes with auto-increment,
+*  SWRST on the general call. Channel writes go to the simulator trace once the
+*  OFF_H byte of the channel is written.
+*/
+
+#define PCA9685_CHANNEL_COUNT 16
+#define PCA9685_PWM_FULL (uint16_t)0x01000
+#define PCA9685_I2C_BASE_MODULE_ADDRESS (byte)0x40
+
+#define PCA9685_MODE1_REG 0x00
+#define PCA9685_LED0_REG 0x06
+#define PCA9685_ALLLED_REG 0xFA
+#define PCA9685_PRESCALE_REG 0xFE
+#define PCA9685_SW_RESET 0x06			// general call command
+
+#define PCA9685_MODE1_AUTOINC 0x20
+
+namespace sim {
+	// write of /length/ bytes to the device at 7 bit /address/, false if none acknowledged it
+	bool pca9685Write(uint8_t address, const uint8_t *data, uint8_t length);
+}
+
+#endif
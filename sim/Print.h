@@ -0,0 +1,49 @@
+#ifndef _SIM_PRINT_h
+#define _SIM_PRINT_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+class __FlashStringHelper;
+class String;
+
+/*
+*  Arduino Print stand-in. Number and float formatting follows the Arduino core
+*  so replies are byte-identical to what the host sees from the real controller.
+*/
+class Print {
+	public:
+		virtual ~Print() {}
+		virtual size_t write(uint8_t c) = 0;
+		virtual size_t write(const uint8_t *buffer, size_t size);
+		size_t write(const char *str);
+
+		size_t print(const __FlashStringHelper *ifsh);
+		size_t print(const String &s);
+		size_t print(const char str[]);
+		size_t print(char c);
+		size_t print(unsigned char n, int base = 10);
+		size_t print(int n, int base = 10);
+		size_t print(unsigned int n, int base = 10);
+		size_t print(long n, int base = 10);
+		size_t print(unsigned long n, int base = 10);
+		size_t print(double n, int digits = 2);
+
+		size_t println(const __FlashStringHelper *ifsh);
+		size_t println(const String &s);
+		size_t println(const char str[]);
+		size_t println(char c);
+		size_t println(unsigned char n, int base = 10);
+		size_t println(int n, int base = 10);
+		size_t println(unsigned int n, int base = 10);
+		size_t println(long n, int base = 10);
+		size_t println(unsigned long n, int base = 10);
+		size_t println(double n, int digits = 2);
+		size_t println(void);
+
+	private:
+		size_t printNumber(unsigned long n, uint8_t base);
+		size_t printFloat(double number, uint8_t digits);
+};
+
+#endif
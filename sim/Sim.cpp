@@ -0,0 +1,387 @@
+#include "Sim.h"
+#include "arduino.h"
+#include "EEPROMex.h"
+#include "PCA9685.h"
+#include "MCP23017.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+
+namespace sim {
+
+	Counters counters;
+
+	static uint64_t clockUs = 0;
+	static std::deque<uint8_t> rxQueue;
+	static FILE *traceOut = NULL;
+	static std::string txLine;
+	static SerialTxHook txHook = NULL;
+	static void *txHookContext = NULL;
+	static Interrupt interrupt = NULL;
+
+	uint64_t now() {
+		return clockUs;
+	}
+
+	void advance(uint64_t us) {
+		clockUs += us;
+		if (interrupt)
+			interrupt();
+	}
+
+	void setInterrupt(Interrupt handler) {
+		interrupt = handler;
+	}
+
+	void feedSerial(const char *text) {
+		while (*text)
+			rxQueue.push_back((uint8_t)*text++);
+	}
+
+	int pendingSerial() {
+		return (int)rxQueue.size();
+	}
+
+	void setTrace(FILE *out) {
+		traceOut = out;
+	}
+
+	FILE *trace() {
+		return traceOut;
+	}
+
+	void setSerialTxHook(SerialTxHook hook, void *context) {
+		txHook = hook;
+		txHookContext = context;
+	}
+
+	static void traceStamp() {
+		fprintf(traceOut, "%10.3f ", clockUs / 1000.0);
+	}
+
+	struct ServoState {
+		float angle;		// negative: no pulse yet, position unknown
+		float target;
+		uint64_t since;		// virtual time /angle/ is valid for
+		bool moving;
+	};
+
+	static std::map<uint16_t, ServoState> servos;		// by bus address << 8 | channel
+	static uint16_t servoPwm0 = 0;
+	static uint16_t servoPwm180 = 0;
+	static float servoSpeed = 0;		// degree per ms, 0: no model
+
+	void setServoModel(uint16_t pwm0, uint16_t pwm180, float degreesPerMs) {
+		servoPwm0 = pwm0;
+		servoPwm180 = pwm180;
+		servoSpeed = degreesPerMs;
+		servos.clear();
+	}
+
+	static void moveServo(ServoState &servo) {
+		float step = servoSpeed * (clockUs - servo.since) / 1000.0f;
+		if (fabsf(servo.target - servo.angle) <= step)
+			servo.angle = servo.target;
+		else
+			servo.angle += servo.target > servo.angle ? step : -step;
+		servo.since = clockUs;
+	}
+
+	static void setServoPulse(uint8_t address, uint8_t channel, uint16_t pwm) {
+		std::map<uint16_t, ServoState>::iterator it = servos.find((uint16_t)address << 8 | channel);
+		if (it == servos.end())
+			it = servos.insert(std::make_pair((uint16_t)address << 8 | channel, ServoState { -1, -1, clockUs, false })).first;
+		ServoState &servo = it->second;
+
+		if (servo.angle >= 0)
+			moveServo(servo);
+
+		//full off or full on: no pulses, the servo stops where it is
+		if (pwm == 0 || pwm >= PCA9685_PWM_FULL) {
+			servo.target = servo.angle;
+			return;
+		}
+
+		float target = ((float)pwm - servoPwm0) * 180 / ((float)servoPwm180 - servoPwm0);
+		servo.target = constrain(target, 0.0f, 180.0f);
+		//first pulse: where the lever was before is not known
+		if (servo.angle < 0)
+			servo.angle = servo.target;
+		servo.since = clockUs;
+		servo.moving = servo.angle != servo.target;
+	}
+
+	float servoAngle(uint8_t address, uint8_t channel) {
+		std::map<uint16_t, ServoState>::iterator it = servos.find((uint16_t)address << 8 | channel);
+		if (it == servos.end())
+			return -1;
+		if (it->second.angle >= 0)
+			moveServo(it->second);
+		return it->second.angle;
+	}
+
+	int updateServos() {
+		int moving = 0;
+		for (std::map<uint16_t, ServoState>::iterator it = servos.begin(); it != servos.end(); ++it) {
+			ServoState &servo = it->second;
+			if (!servo.moving)
+				continue;
+			moveServo(servo);
+			if (servo.angle == servo.target) {
+				servo.moving = false;
+				if (traceOut) {
+					traceStamp();
+					fprintf(traceOut, "servo 0x%02X ch %d at %.1f deg\n", it->first >> 8, it->first & 0xFF, servo.angle);
+				}
+			} else {
+				moving++;
+			}
+		}
+		return moving;
+	}
+
+	void logPWM(uint8_t address, int channel, uint16_t pwm) {
+		if (servoSpeed > 0) {
+			for (int i = channel < 0 ? 0 : channel; i <= (channel < 0 ? PCA9685_CHANNEL_COUNT - 1 : channel); i++)
+				setServoPulse(address, i, pwm);
+		}
+		if (!traceOut)
+			return;
+		traceStamp();
+		if (channel < 0)
+			fprintf(traceOut, "pwm 0x%02X ch * = %u\n", address, pwm);
+		else
+			fprintf(traceOut, "pwm 0x%02X ch %d = %u\n", address, channel, pwm);
+	}
+
+	unsigned long i2cBusTime(uint8_t bytes, uint32_t clock) {
+		//START, 9 bits per byte (ACK), STOP
+		return (unsigned long)(((uint64_t)bytes * 9 + 2) * 1000000 / clock);
+	}
+
+	static std::set<uint8_t> missingDevices;
+
+	void setI2CDeviceMissing(uint8_t address, bool missing) {
+		if (missing)
+			missingDevices.insert(address);
+		else
+			missingDevices.erase(address);
+	}
+
+	bool i2cTransfer(uint8_t address, const uint8_t *data, uint8_t length, uint8_t *readData, uint8_t readLength, uint32_t clock) {
+		uint8_t bytes = 1 + length + (readLength ? 1 + readLength : 0);
+		counters.i2cTransactions++;
+		counters.i2cBytes += bytes;
+		counters.i2cBusUs += i2cBusTime(bytes, clock);
+
+		if (missingDevices.count(address))
+			return false;
+
+		if (address >= MCP23017_I2C_BASE_ADDRESS && address < MCP23017_I2C_BASE_ADDRESS + MCP23017_DEVICES)
+			return mcp23017Transfer(address, data, length, readData, readLength);
+		//the PCA9685s are only written to
+		if (readLength != 0)
+			return false;
+		return pca9685Write(address, data, length);
+	}
+
+	static void logSerialTx(uint8_t c) {
+		counters.serialTxBytes++;
+		if (txHook)
+			txHook(c, txHookContext);
+		if (!traceOut)
+			return;
+		if (c == '\n') {
+			traceStamp();
+			fprintf(traceOut, "tx  %s\n", txLine.c_str());
+			txLine.clear();
+		} else if (c != '\r') {
+			txLine += (char)c;
+		}
+	}
+
+	bool loadEEPROM(const char *path) {
+		FILE *f = fopen(path, "rb");
+		if (!f)
+			return false;
+		size_t n = fread(EEPROM.cells, 1, sizeof(EEPROM.cells), f);
+		fclose(f);
+		return n == sizeof(EEPROM.cells);
+	}
+
+	bool saveEEPROM(const char *path) {
+		FILE *f = fopen(path, "wb");
+		if (!f)
+			return false;
+		size_t n = fwrite(EEPROM.cells, 1, sizeof(EEPROM.cells), f);
+		fclose(f);
+		return n == sizeof(EEPROM.cells);
+	}
+
+	void resetCounters() {
+		counters = Counters();
+	}
+
+	void printCounters(FILE *out, const char *prefix) {
+		fprintf(out, "%si2c_transactions=%lu\n", prefix, counters.i2cTransactions);
+		fprintf(out, "%si2c_bytes=%lu\n", prefix, counters.i2cBytes);
+		fprintf(out, "%si2c_bus_us=%lu\n", prefix, counters.i2cBusUs);
+		fprintf(out, "%schannel_writes=%lu\n", prefix, counters.channelWrites);
+		fprintf(out, "%sinvalid_channel_writes=%lu\n", prefix, counters.invalidChannelWrites);
+		fprintf(out, "%sserial_calls=%lu\n", prefix, counters.serialCalls);
+		fprintf(out, "%sserial_tx_bytes=%lu\n", prefix, counters.serialTxBytes);
+		fprintf(out, "%sserial_rx_bytes=%lu\n", prefix, counters.serialRxBytes);
+		fprintf(out, "%sserial_tx_stall_us=%lu\n", prefix, counters.serialTxStallUs);
+		fprintf(out, "%seeprom_writes=%lu\n", prefix, counters.eepromWrites);
+		fprintf(out, "%sstring_allocations=%lu\n", prefix, counters.stringAllocations);
+	}
+
+	void serialTx(uint8_t c) {
+		logSerialTx(c);
+	}
+
+	int serialRx() {
+		if (rxQueue.empty())
+			return -1;
+		uint8_t c = rxQueue.front();
+		rxQueue.pop_front();
+		counters.serialRxBytes++;
+		return c;
+	}
+
+	int serialPeek() {
+		if (rxQueue.empty())
+			return -1;
+		return rxQueue.front();
+	}
+}
+
+
+// ------------------  A R D U I N O   C O R E -----------------------
+
+unsigned long millis() {
+	return (unsigned long)(sim::now() / 1000);
+}
+
+unsigned long micros() {
+	return (unsigned long)sim::now();
+}
+
+void delay(unsigned long ms) {
+	sim::advance((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+	sim::advance(us);
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+	return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+// nothing is wired to the pins in the simulator: pulled up, i.e. inactive (feedback lines are on the MCP23017s)
+void pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+int digitalRead(uint8_t pin) { (void)pin; return HIGH; }
+void digitalWrite(uint8_t pin, uint8_t val) { (void)pin; (void)val; }
+
+
+// ------------------  S E R I A L -----------------------
+
+HardwareSerial Serial;
+
+int HardwareSerial::available() { sim::counters.serialCalls++; return sim::pendingSerial(); }
+int HardwareSerial::peek() { sim::counters.serialCalls++; return sim::serialPeek(); }
+int HardwareSerial::read() { sim::counters.serialCalls++; return sim::serialRx(); }
+static uint64_t serialUsPerByte = 0;		// 0: not begun, bytes leave at once
+static uint64_t serialTxBusyUntil = 0;		// virtual time the last byte in the TX FIFO is sent
+
+void HardwareSerial::begin(unsigned long baud) {
+	serialUsPerByte = baud ? (10000000ULL + baud - 1) / baud : 0;
+	serialTxBusyUntil = sim::now();
+}
+
+int HardwareSerial::availableForWrite() {
+	sim::counters.serialCalls++;
+	if (serialUsPerByte == 0 || serialTxBusyUntil <= sim::now())
+		return SIM_SERIAL_TX_FIFO_SIZE;
+	uint64_t queued = (serialTxBusyUntil - sim::now() + serialUsPerByte - 1) / serialUsPerByte;
+	return queued >= SIM_SERIAL_TX_FIFO_SIZE ? 0 : SIM_SERIAL_TX_FIFO_SIZE - (int)queued;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+	sim::counters.serialCalls++;
+	if (serialUsPerByte != 0) {
+		//block until there is room for one more byte
+		if (availableForWrite() == 0) {
+			uint64_t stall = serialTxBusyUntil - (SIM_SERIAL_TX_FIFO_SIZE - 1) * serialUsPerByte - sim::now();
+			sim::counters.serialTxStallUs += stall;
+			sim::advance(stall);
+		}
+		if (serialTxBusyUntil < sim::now())
+			serialTxBusyUntil = sim::now();
+		serialTxBusyUntil += serialUsPerByte;
+	}
+	sim::serialTx(c);
+	return 1;
+}
+
+
+// ------------------  E E P R O M -----------------------
+
+EEPROMClassEx EEPROM;
+
+static uint64_t eepromBusyUntil = 0;		// virtual time the cell being programmed is done
+
+EEPROMClassEx::EEPROMClassEx() {
+	// erased cells read 0xFF
+	memset(cells, 0xFF, sizeof(cells));
+}
+
+bool EEPROMClassEx::isReady() {
+	return sim::now() >= eepromBusyUntil;
+}
+
+void EEPROMClassEx::waitReady() {
+	if (!isReady())
+		sim::advance(eepromBusyUntil - sim::now());
+}
+
+uint8_t EEPROMClassEx::read(int address) {
+	if (!isReadOk(address))
+		return 0;
+	waitReady();
+	return cells[address];
+}
+
+//the library's write count: every write, update and block call, not the cells
+bool EEPROMClassEx::isWriteOk(int address) {
+	writeCounts = (int16_t)(uint16_t)(writeCounts + 1);
+	if (allowedWrites == 0 || writeCounts > allowedWrites) {
+		Serial.println("Exceeded maximum number of writes");
+		return false;
+	}
+	return address >= 0 && address < SIM_EEPROM_SIZE;
+}
+
+void EEPROMClassEx::program(int address, uint8_t value) {
+	waitReady();
+	cells[address] = value;
+	sim::counters.eepromWrites++;
+	eepromBusyUntil = sim::now() + SIM_EEPROM_WRITE_TIME_US;
+}
+
+bool EEPROMClassEx::write(int address, uint8_t value) {
+	if (!isWriteOk(address))
+		return false;
+	program(address, value);
+	return true;
+}
+
+bool EEPROMClassEx::update(int address, uint8_t value) {
+	if (!isWriteOk(address) || read(address) == value)
+		return false;
+	program(address, value);
+	return true;
+}
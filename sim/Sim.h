@@ -0,0 +1,84 @@
+#ifndef _SIM_h
+#define _SIM_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+*  Control interface of the host simulator.
+*  The virtual clock only moves when the driver advances it (or when the
+*  firmware calls delay() / programs EEPROM cells), so every run is repeatable.
+*/
+namespace sim {
+
+	struct Counters {
+		unsigned long i2cTransactions;		// START..STOP sequences on the bus
+		unsigned long i2cBytes;				// bytes clocked out incl. address byte
+		unsigned long i2cBusUs;				// virtual time the bus was busy (in the background, the firmware queues transactions)
+		unsigned long channelWrites;		// PCA9685 channel registers written
+		unsigned long invalidChannelWrites;	// PCA9685 writes past the last channel, to reserved registers
+		unsigned long serialCalls;			// calls into Serial (available, read, peek, write, availableForWrite)
+		unsigned long serialTxBytes;
+		unsigned long serialRxBytes;
+		unsigned long serialTxStallUs;		// virtual time spent blocked in Serial.write() on a full TX FIFO
+		unsigned long eepromWrites;			// cells actually programmed
+		unsigned long stringAllocations;	// heap (re)allocations by String
+	};
+
+	extern Counters counters;
+
+	// virtual clock in microseconds since simulated power on
+	uint64_t now();
+	void advance(uint64_t us);
+
+	// runs after every advance of the clock, as a hardware interrupt would have meanwhile (the I²C queue's TWI interrupt)
+	typedef void (*Interrupt)();
+	void setInterrupt(Interrupt handler);
+
+	// queue bytes to be read by the firmware from Serial
+	void feedSerial(const char *text);
+	int pendingSerial();
+
+	// trace of pwm writes and serial output, NULL to disable
+	void setTrace(FILE *out);
+	FILE *trace();
+
+	// hook called with every byte the firmware sends on Serial
+	typedef void (*SerialTxHook)(uint8_t c, void *context);
+	void setSerialTxHook(SerialTxHook hook, void *context);
+
+	// servo model: every channel with a pulse drives a servo that turns towards the angle of the pulse
+	// (pwm0 at 0°, pwm180 at 180°) at /degreesPerMs/. Off until set, it costs a lookup per channel write
+	void setServoModel(uint16_t pwm0, uint16_t pwm180, float degreesPerMs);
+	// angle of the servo on /channel/ of the controller at bus /address/, negative if it never had a pulse
+	float servoAngle(uint8_t address, uint8_t channel);
+	// move the servos up to now and trace the ones that reached their angle, returns how many still move
+	int updateServos();
+
+	// level of /pin/ (0..15: GPA0..GPB7) of the MCP23017 at bus /address/. pins read high unless set low
+	void setExpanderPin(uint8_t address, uint8_t pin, bool level);
+
+	// device at bus /address/ not acknowledging anything (missing, unplugged), false: answers again
+	void setI2CDeviceMissing(uint8_t address, bool missing);
+
+	// EEPROM image persistence across simulated power cycles
+	bool loadEEPROM(const char *path);
+	bool saveEEPROM(const char *path);
+
+	void resetCounters();
+	void printCounters(FILE *out, const char *prefix);
+
+	// used by the stand-ins
+	void logPWM(uint8_t address, int channel, uint16_t pwm);
+	void serialTx(uint8_t c);
+	int serialRx();
+	int serialPeek();
+
+	// I²C bus, used by the firmware's I2CQueue in place of the TWI hardware
+	// transaction writing /length/ bytes to 7 bit /address/, then reading /readLength/ after a repeated START, false on NACK
+	bool i2cTransfer(uint8_t address, const uint8_t *data, uint8_t length, uint8_t *readData, uint8_t readLength, uint32_t clock);
+	// [µs] on the bus for /bytes/ (address byte included) at /clock/
+	unsigned long i2cBusTime(uint8_t bytes, uint32_t clock);
+}
+
+#endif
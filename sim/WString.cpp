@@ -0,0 +1,216 @@
+#include "WString.h"
+#include "arduino.h"
+#include "Sim.h"
+
+#include <stdio.h>
+#include <ctype.h>
+
+// the AVR core mallocs on every construction and reallocs whenever a string outgrows its buffer
+void String::grow(unsigned int size) {
+	if (size <= capacity && capacity != 0)
+		return;
+	capacity = size;
+	sim::counters.stringAllocations++;
+}
+
+String::String(const char *cstr) : buffer(cstr ? cstr : ""), capacity(0) {
+	grow(buffer.length());
+}
+
+String::String(const __FlashStringHelper *str) : buffer((const char *)str), capacity(0) {
+	grow(buffer.length());
+}
+
+String::String(const String &str) : buffer(str.buffer), capacity(0) {
+	grow(buffer.length());
+}
+
+String::String(char c) : buffer(1, c), capacity(0) {
+	grow(1);
+}
+
+static std::string formatInteger(unsigned long value, bool negative, unsigned char base) {
+	char tmp[8 * sizeof(unsigned long) + 2];
+	char *p = &tmp[sizeof(tmp) - 1];
+	*p = '\0';
+	if (base < 2)
+		base = 10;
+	do {
+		unsigned long digit = value % base;
+		*--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+		value /= base;
+	} while (value);
+	if (negative)
+		*--p = '-';
+	return std::string(p);
+}
+
+String::String(unsigned char value, unsigned char base) : buffer(formatInteger(value, false, base)), capacity(0) {
+	grow(buffer.length());
+}
+
+String::String(int value, unsigned char base) : capacity(0) {
+	bool negative = (base == 10 && value < 0);
+	buffer = formatInteger(negative ? -(long)value : (unsigned int)value, negative, base);
+	grow(buffer.length());
+}
+
+String::String(unsigned int value, unsigned char base) : buffer(formatInteger(value, false, base)), capacity(0) {
+	grow(buffer.length());
+}
+
+String::String(long value, unsigned char base) : capacity(0) {
+	bool negative = (base == 10 && value < 0);
+	buffer = formatInteger(negative ? -(unsigned long)value : (unsigned long)value, negative, base);
+	grow(buffer.length());
+}
+
+String::String(unsigned long value, unsigned char base) : buffer(formatInteger(value, false, base)), capacity(0) {
+	grow(buffer.length());
+}
+
+String::String(float value, unsigned char decimalPlaces) : capacity(0) {
+	char tmp[40];
+	snprintf(tmp, sizeof(tmp), "%.*f", decimalPlaces, (double)value);
+	buffer = tmp;
+	grow(buffer.length());
+}
+
+String::String(double value, unsigned char decimalPlaces) : capacity(0) {
+	char tmp[40];
+	snprintf(tmp, sizeof(tmp), "%.*f", decimalPlaces, value);
+	buffer = tmp;
+	grow(buffer.length());
+}
+
+String::~String() {}
+
+String & String::operator = (const String &rhs) {
+	if (this != &rhs) {
+		grow(rhs.buffer.length());
+		buffer = rhs.buffer;
+	}
+	return *this;
+}
+
+String & String::operator = (const char *cstr) {
+	std::string tmp(cstr ? cstr : "");
+	grow(tmp.length());
+	buffer = tmp;
+	return *this;
+}
+
+String & String::operator += (const String &rhs) {
+	grow(buffer.length() + rhs.buffer.length());
+	buffer += rhs.buffer;
+	return *this;
+}
+
+String & String::operator += (const char *cstr) {
+	if (cstr) {
+		grow(buffer.length() + strlen(cstr));
+		buffer += cstr;
+	}
+	return *this;
+}
+
+String & String::operator += (char c) {
+	grow(buffer.length() + 1);
+	buffer += c;
+	return *this;
+}
+
+bool String::reserve(unsigned int size) {
+	grow(size);
+	buffer.reserve(size);
+	return true;
+}
+
+char String::charAt(unsigned int index) const {
+	if (index >= buffer.length())
+		return 0;
+	return buffer[index];
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const {
+	if (fromIndex >= buffer.length())
+		return -1;
+	size_t pos = buffer.find(ch, fromIndex);
+	return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String &str, unsigned int fromIndex) const {
+	if (fromIndex >= buffer.length())
+		return -1;
+	size_t pos = buffer.find(str.buffer, fromIndex);
+	return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int beginIndex) const {
+	return substring(beginIndex, buffer.length());
+}
+
+String String::substring(unsigned int left, unsigned int right) const {
+	if (left > right) {
+		unsigned int temp = right;
+		right = left;
+		left = temp;
+	}
+	String out;
+	if (left >= buffer.length())
+		return out;
+	if (right > buffer.length())
+		right = buffer.length();
+	out.buffer = buffer.substr(left, right - left);
+	out.grow(out.buffer.length());
+	return out;
+}
+
+void String::remove(unsigned int index) {
+	// like the core: index past the end (also (unsigned)-1 from a failed indexOf) is a no-op
+	if (index >= buffer.length())
+		return;
+	buffer.erase(index);
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+	if (index >= buffer.length())
+		return;
+	buffer.erase(index, count);
+}
+
+void String::trim() {
+	size_t begin = 0;
+	size_t end = buffer.length();
+	while (begin < end && isspace((unsigned char)buffer[begin]))
+		begin++;
+	while (end > begin && isspace((unsigned char)buffer[end - 1]))
+		end--;
+	buffer = buffer.substr(begin, end - begin);
+}
+
+long String::toInt() const {
+	return atol(buffer.c_str());
+}
+
+float String::toFloat() const {
+	return (float)atof(buffer.c_str());
+}
+
+String operator + (const String &lhs, const String &rhs) {
+	String out(lhs);
+	out += rhs;
+	return out;
+}
+
+String operator + (const String &lhs, const char *rhs) {
+	String out(lhs);
+	out += rhs;
+	return out;
+}
+
+String operator + (const char *lhs, const String &rhs) {
+	String out(lhs);
+	out += rhs;
+	return out;
+}
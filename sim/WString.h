@@ -0,0 +1,65 @@
+#ifndef _SIM_WSTRING_h
+#define _SIM_WSTRING_h
+
+#include <string>
+
+class __FlashStringHelper;
+
+/*
+*  Minimal Arduino String stand-in for the host build.
+*  Backed by std::string; every heap (re)allocation is counted in sim::counters.
+*/
+class String {
+	public:
+		String(const char *cstr = "");
+		String(const __FlashStringHelper *str);
+		String(const String &str);
+		explicit String(char c);
+		explicit String(unsigned char value, unsigned char base = 10);
+		explicit String(int value, unsigned char base = 10);
+		explicit String(unsigned int value, unsigned char base = 10);
+		explicit String(long value, unsigned char base = 10);
+		explicit String(unsigned long value, unsigned char base = 10);
+		explicit String(float value, unsigned char decimalPlaces = 2);
+		explicit String(double value, unsigned char decimalPlaces = 2);
+		~String();
+
+		String & operator = (const String &rhs);
+		String & operator = (const char *cstr);
+
+		String & operator += (const String &rhs);
+		String & operator += (const char *cstr);
+		String & operator += (char c);
+
+		bool operator == (const String &rhs) const { return buffer == rhs.buffer; }
+		bool operator != (const String &rhs) const { return buffer != rhs.buffer; }
+
+		bool reserve(unsigned int size);
+		unsigned int length() const { return buffer.length(); }
+		const char *c_str() const { return buffer.c_str(); }
+		char charAt(unsigned int index) const;
+		char operator [] (unsigned int index) const { return charAt(index); }
+
+		int indexOf(char ch, unsigned int fromIndex = 0) const;
+		int indexOf(const String &str, unsigned int fromIndex = 0) const;
+		String substring(unsigned int beginIndex) const;
+		String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+		void remove(unsigned int index);
+		void remove(unsigned int index, unsigned int count);
+		void trim();
+
+		long toInt() const;
+		float toFloat() const;
+
+	private:
+		std::string buffer;
+		unsigned int capacity;				// capacity the AVR core would have allocated
+		void grow(unsigned int size);
+};
+
+String operator + (const String &lhs, const String &rhs);
+String operator + (const String &lhs, const char *rhs);
+String operator + (const char *lhs, const String &rhs);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef _SIM_ARDUINO_h
+#define _SIM_ARDUINO_h
+
+/*
+*  Host stand-in for the Arduino core, used by [env:native]. Lower case name
+*  because the firmware includes it as "arduino.h".
+*  Only what the firmware actually uses is provided. Time is virtual and
+*  controlled by the simulator (see Sim.h), so runs are deterministic.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define B000000 0
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_ptr(addr) (*(void * const *)(addr))
+
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+inline boolean isAlpha(int c) { return isalpha(c) != 0; }
+inline boolean isDigit(int c) { return isdigit(c) != 0; }
+inline boolean isSpace(int c) { return isspace(c) != 0; }
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+
+#include "WString.h"
+#include "Print.h"
+#include "HardwareSerial.h"
+
+#endif
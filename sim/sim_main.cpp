@@ -0,0 +1,186 @@
+/*
+*  Host simulator driver for the feeder firmware ([env:native]).
+*
+*  Runs setup() once and then loop() against a virtual clock, feeding G-code
+*  from a script. Every PCA9685 channel write and every line sent on Serial is
+*  traced with its virtual timestamp; wall clock time per loop() is measured.
+*
+*  usage: program [-q] [-t us_per_loop] [-e eeprom.bin] [script]
+*    -q    no trace, only statistics
+*    -t    virtual time that passes per loop() iteration, default 100 µs
+*    -e    EEPROM image, loaded on start (if present) and saved on exit
+*
+*  script lines (stdin if no script is given):
+*    M600 N3         sent to the firmware as is
+*    @wait 500       run loop() for 500 ms of virtual time
+*    @reply [ms]     run loop() until the next "ok"/"error" line (timeout default 10000 ms)
+*    @stats          print and reset statistics
+*    @line 3 0       feedback line of feeder 3 low (tensioner switch closed), 1: high again
+*    @missing 41 1   device at bus address 0x41 does not answer, 0: answers again
+*    # comment
+*/
+
+// the unit tests in test/ link the firmware and sim/ with a main() of their own
+#ifndef PIO_UNIT_TESTING
+
+#include "Sim.h"
+#include "MCP23017.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+
+void setup();
+void loop();
+
+struct sLoopStats {
+	unsigned long loops;
+	uint64_t wallNs;
+	uint64_t wallNsMax;
+	uint64_t startUs;
+};
+
+static sLoopStats loopStats;
+static uint64_t usPerLoop = 100;
+
+static std::string replyLine;
+static unsigned long replies = 0;
+
+static void onSerialTx(uint8_t c, void *context) {
+	(void)context;
+	if (c == '\n') {
+		if (replyLine.compare(0, 2, "ok") == 0 || replyLine.compare(0, 5, "error") == 0)
+			replies++;
+		replyLine.clear();
+	} else if (c != '\r') {
+		replyLine += (char)c;
+	}
+}
+
+static void runLoopOnce() {
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	loop();
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+
+	loopStats.loops++;
+	loopStats.wallNs += ns;
+	if (ns > loopStats.wallNsMax)
+		loopStats.wallNsMax = ns;
+
+	sim::advance(usPerLoop);
+}
+
+static void printStats() {
+	printf("stat virtual_ms=%.3f\n", (sim::now() - loopStats.startUs) / 1000.0);
+	printf("stat loops=%lu\n", loopStats.loops);
+	printf("stat loop_ns_avg=%llu\n", (unsigned long long)(loopStats.loops ? loopStats.wallNs / loopStats.loops : 0));
+	printf("stat loop_ns_max=%llu\n", (unsigned long long)loopStats.wallNsMax);
+	printf("stat replies=%lu\n", replies);
+	sim::printCounters(stdout, "stat ");
+	fflush(stdout);
+
+	loopStats = sLoopStats();
+	loopStats.startUs = sim::now();
+	replies = 0;
+	sim::resetCounters();
+}
+
+static void runScriptLine(char *line) {
+	line[strcspn(line, "\r\n")] = '\0';
+	while (*line == ' ' || *line == '\t')
+		line++;
+
+	if (*line == '\0' || *line == '#')
+		return;
+
+	if (strncmp(line, "@wait", 5) == 0) {
+		uint64_t end = sim::now() + (uint64_t)atol(line + 5) * 1000;
+		while (sim::now() < end)
+			runLoopOnce();
+	} else if (strncmp(line, "@reply", 6) == 0) {
+		long timeout = atol(line + 6);
+		if (timeout <= 0)
+			timeout = 10000;
+		uint64_t start = sim::now();
+		uint64_t end = start + (uint64_t)timeout * 1000;
+		unsigned long expected = replies + 1;
+		while (replies < expected && sim::now() < end)
+			runLoopOnce();
+		if (replies < expected)
+			printf("reply timeout after %ld ms\n", timeout);
+		else
+			printf("reply after %.3f ms\n", (sim::now() - start) / 1000.0);
+	} else if (strncmp(line, "@stats", 6) == 0) {
+		printStats();
+	} else if (strncmp(line, "@line", 5) == 0) {
+		// feeder n is pin n%16 of the port expander n/16 (shield.h)
+		char *level;
+		unsigned long feederNo = strtoul(line + 5, &level, 10);
+		sim::setExpanderPin(MCP23017_I2C_BASE_ADDRESS + feederNo / 16, feederNo % 16, atoi(level) != 0);
+	} else if (strncmp(line, "@missing", 8) == 0) {
+		char *missing;
+		unsigned long address = strtoul(line + 8, &missing, 16);
+		sim::setI2CDeviceMissing(address, atoi(missing) != 0);
+	} else if (*line == '@') {
+		fprintf(stderr, "unknown directive: %s\n", line);
+	} else {
+		sim::feedSerial(line);
+		sim::feedSerial("\n");
+	}
+}
+
+int main(int argc, char **argv) {
+	const char *eepromImage = NULL;
+	const char *script = NULL;
+	bool quiet = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-q") == 0) {
+			quiet = true;
+		} else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			usPerLoop = strtoull(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+			eepromImage = argv[++i];
+		} else if (argv[i][0] != '-') {
+			script = argv[i];
+		} else {
+			fprintf(stderr, "usage: %s [-q] [-t us_per_loop] [-e eeprom.bin] [script]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	FILE *in = stdin;
+	if (script && !(in = fopen(script, "r"))) {
+		perror(script);
+		return 1;
+	}
+
+	if (eepromImage)
+		sim::loadEEPROM(eepromImage);
+
+	sim::setTrace(quiet ? NULL : stdout);
+	sim::setSerialTxHook(onSerialTx, NULL);
+
+	setup();
+	printf("boot took %.3f ms\n", sim::now() / 1000.0);
+	printStats();
+
+	char line[256];
+	while (fgets(line, sizeof(line), in))
+		runScriptLine(line);
+
+	// let whatever was sent last be processed
+	while (sim::pendingSerial())
+		runLoopOnce();
+
+	printStats();
+
+	if (eepromImage && !sim::saveEEPROM(eepromImage))
+		perror(eepromImage);
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,131 @@
+#include "FeedbackLines.h"
+
+#ifdef HAS_FEEDBACKLINES
+
+#include "I2CQueue.h"
+
+//MCP23017 registers, IOCON.BANK = 0 (power on): A and B side by side, the pointer advances by itself
+#define MCP23017_GPPUA 0x0C
+#define MCP23017_GPIOA 0x12
+
+#define FEEDBACK_EXPANDERS_ALL (uint8_t)((1U << NUMBER_OF_EXPANDERS) - 1)
+//bits of the last byte that belong to feeders
+#define FEEDBACK_LAST_BYTE_MASK (uint8_t)(NUMBER_OF_FEEDER % 8 == 0 ? 0xFF : (1U << (NUMBER_OF_FEEDER % 8)) - 1)
+
+uint8_t feedbackLines[FEEDBACK_BYTES];
+uint8_t feedbackManualFeeds[FEEDBACK_BYTES];
+
+static uint8_t samples[NUMBER_OF_EXPANDERS * 2];		// GPIOA, GPIOB of each expander, written by the interrupt
+static volatile uint8_t expandersAnswered;				// bit per expander, this scan
+static volatile uint8_t expandersFailed;
+static uint8_t expandersPosted;
+static bool scanRunning = false;
+static unsigned long lastScan;
+
+//vertical counters, bit n of byte i counts for feeder 8i+n
+static uint8_t debounce0[FEEDBACK_BYTES];				// scans in a row a line read different from feedbackLines
+static uint8_t debounce1[FEEDBACK_BYTES];
+static uint8_t hold[FEEDBACK_HOLD_BITS][FEEDBACK_BYTES];	// scans a line is pressed
+static uint8_t heldTooLong[FEEDBACK_BYTES];				// hold counter overflowed: no manual feed on release
+
+//called from the interrupt. /tag/: expander
+static void expanderDone(void *context, uint16_t tag, eI2CResult result, unsigned long us) {
+	(void)context;
+	(void)us;
+	if (result != I2C_RESULT_OK)
+		expandersFailed |= 1 << tag;
+	expandersAnswered |= 1 << tag;
+}
+
+static bool postRead(uint8_t expander) {
+	uint8_t reg = MCP23017_GPIOA;
+	return i2cQueuePostRead(FEEDBACK_EXPANDER_BASE_ADDRESS + expander, &reg, 1, &samples[2 * expander], 2, expanderDone, NULL, expander);
+}
+
+//lines pressed as read by this scan, an expander that did not answer keeps its lines as they are
+static uint8_t pressedSample(uint8_t i) {
+	uint8_t pressed = (expandersFailed & (1 << (i >> 1))) ? feedbackLines[i] : (uint8_t)~samples[i];
+	if (i == FEEDBACK_BYTES - 1)
+		pressed &= FEEDBACK_LAST_BYTE_MASK;
+	return pressed;
+}
+
+void feedbackLinesBegin() {
+	for (uint8_t expander = 0; expander < NUMBER_OF_EXPANDERS; expander++) {
+		uint8_t pullUps[3] = { MCP23017_GPPUA, 0xFF, 0xFF };
+		i2cQueuePost(FEEDBACK_EXPANDER_BASE_ADDRESS + expander, pullUps, sizeof(pullUps));
+		i2cQueueWait();
+	}
+
+	expandersAnswered = 0;
+	expandersFailed = 0;
+	for (uint8_t expander = 0; expander < NUMBER_OF_EXPANDERS; expander++) {
+		postRead(expander);
+		i2cQueueWait();
+	}
+
+	//lines pressed on power on are the cover tape in place, their release is no manual feed
+	for (uint8_t i = 0; i < FEEDBACK_BYTES; i++) {
+		feedbackLines[i] = pressedSample(i);
+		heldTooLong[i] = feedbackLines[i];
+	}
+	lastScan = millis();
+}
+
+//one scan for all feeders, 8 at a time
+static void debounceScan() {
+	for (uint8_t i = 0; i < FEEDBACK_BYTES; i++) {
+		//2 bit counters of the lines that differ, back to 0 for the ones that do not. the 4th scan in a row changes the line
+		uint8_t changed = pressedSample(i) ^ feedbackLines[i];
+		debounce1[i] = (debounce1[i] ^ debounce0[i]) & changed;
+		debounce0[i] = ~debounce0[i] & changed;
+		uint8_t toggle = changed & ~(debounce0[i] | debounce1[i]);
+		feedbackLines[i] ^= toggle;
+
+		uint8_t pressed = feedbackLines[i];
+		feedbackManualFeeds[i] |= toggle & ~pressed & ~heldTooLong[i];
+
+		//count the hold time of the pressed lines, the carry out of the last bit is held too long
+		uint8_t carry = pressed & ~heldTooLong[i];
+		for (uint8_t bit = 0; bit < FEEDBACK_HOLD_BITS; bit++) {
+			uint8_t next = hold[bit][i] & carry;
+			hold[bit][i] ^= carry;
+			carry = next;
+		}
+		heldTooLong[i] |= carry;
+
+		//released lines start over
+		for (uint8_t bit = 0; bit < FEEDBACK_HOLD_BITS; bit++)
+			hold[bit][i] &= pressed;
+		heldTooLong[i] &= pressed;
+	}
+}
+
+void feedbackLinesScan(unsigned long now) {
+	if (!scanRunning) {
+		if (now - lastScan < FEEDBACK_SCAN_MS)
+			return;
+		lastScan = now;
+		scanRunning = true;
+		expandersPosted = 0;
+		expandersAnswered = 0;
+		expandersFailed = 0;
+	}
+
+	//reads that did not fit the queue go on the next call
+	for (uint8_t expander = 0; expander < NUMBER_OF_EXPANDERS; expander++) {
+		if (expandersPosted & (1 << expander))
+			continue;
+		if (!postRead(expander))
+			return;
+		expandersPosted |= 1 << expander;
+	}
+
+	if (expandersAnswered != FEEDBACK_EXPANDERS_ALL)
+		return;
+
+	scanRunning = false;
+	debounceScan();
+}
+
+#endif
@@ -1,5 +1,26 @@
 #include "Feeder.h"
 #include "config.h"
+#include "MotionTimer.h"
+#include "SerialTx.h"
+#include "FeedbackLines.h"
+
+uint8_t FeederClass::activeFeeders[(NUMBER_OF_FEEDER + 7) / 8];
+uint8_t FeederClass::unsavedSettings[(NUMBER_OF_FEEDER + 7) / 8];
+uint16_t FeederClass::movingCurrent = 0;
+unsigned long FeederClass::lastMoveAdmitted = 0;
+uint16_t FeederClass::delayedMoves = 0;
+uint16_t FeederClass::maxAdmissionWait = 0;
+uint16_t FeederClass::peakMovingCurrent = 0;
+ServoControllerClass *FeederClass::servoControllers;
+FeederClass::sFeederMotion FeederClass::motion;
+
+static_assert(NUMBER_OF_FEEDER <= 255, "motion entries are indexed with 8 bit");
+static_assert(SERVO_CONTROLLER_CHANNELS == FEEDERS_PER_CONTROLLER, "feeder mapping does not match the controller");
+static_assert(FEEDER_SETTINGS_RECORD_SIZE <= FEEDER_SETTINGS_RECORD_SLOT, "feeder settings outgrew their eeprom slot");
+#ifdef E2END
+static_assert(EEPROM_FEEDER_POSITION_ADDRESS_OFFSET + NUMBER_OF_FEEDER <= E2END + 1, "feeder settings do not fit the eeprom");
+#endif
+static_assert(FEEDER_POSITION_PERSIST_IDLE_MS < 65536, "FEEDER_POSITION_PERSIST_IDLE_MS is compared in 16 bit");
 
 bool FeederClass::isInitialized() {
 	if(this->feederNo == -1)
@@ -10,55 +31,170 @@ bool FeederClass::isInitialized() {
 
 void FeederClass::initialize(uint16_t _feederNo) {
 	this->feederNo = _feederNo;
+	//lever assumed at full advance until a move or the saved position says otherwise
+	this->position() = FEEDER_DEFAULT_FULL_ADVANCED_ANGLE * 256;
+	this->targetPosition() = 0;
+	this->updatePWMConversion();
+}
+
+//precompute pwm counts per 1/256 degree (Q16) from the pulsewidths, so no division is needed per update
+void FeederClass::updatePWMConversion() {
+	int32_t range = (int32_t)this->feederSettings.motor_max_pulsewidth - this->feederSettings.motor_min_pulsewidth;
+	int32_t slope = (range * 65536L) / (180L * 256);
+	//the pwm resolution is 12 bit, anything beyond is a misconfiguration anyway
+	this->pwmSlope = constrain(slope, -32767L, 32767L);
+}
+
+//position in 1/256 degree to pwm counts, rounded
+uint16_t FeederClass::positionToPWM(uint16_t position) {
+	return this->feederSettings.motor_min_pulsewidth + (int16_t)(((int32_t)position * this->pwmSlope + 32768L) >> 16);
 }
 
 #ifdef HAS_FEEDBACKLINES
+//every feeder has its line on a port expander (shield.h)
 bool FeederClass::hasFeedbackLine() {
-	if(feederFeedbackPinMap[this->feederNo] != -1) {
-		return true;
-	} else {
-		return false;
-	}
+	return this->feederNo >= 0 && this->feederNo < NUMBER_OF_EXPANDERS * FEEDBACK_LINES_PER_EXPANDER;
 }
 #endif
 
 void FeederClass::outputCurrentSettings() {
-	Serial.print("M");
-	Serial.print(MCODE_UPDATE_FEEDER_CONFIG);
-	Serial.print(" N");
-	Serial.print(this->feederNo);
-	Serial.print(" A");
-	Serial.print(this->feederSettings.full_advanced_angle);
-	Serial.print(" B");
-	Serial.print(this->feederSettings.half_advanced_angle);
-	Serial.print(" C");
-	Serial.print(this->feederSettings.retract_angle);
-	Serial.print(" F");
-	Serial.print(this->feederSettings.feed_length);
-	Serial.print(" S");
-	Serial.print((float)this->feederSettings.advance_angle_speed/256, 3);
-	Serial.print(" R");
-	Serial.print((float)this->feederSettings.retract_angle_speed/256, 3);
-	Serial.print(" U");
-	Serial.print(this->feederSettings.time_to_settle);
-	Serial.print(" V");
-	Serial.print(this->feederSettings.motor_min_pulsewidth);
-	Serial.print(" W");
-	Serial.print(this->feederSettings.motor_max_pulsewidth);
-	Serial.println();
-}
-
-void FeederClass::setup(PCA9685 *controllerList) {
+	serialTx.print(F("M"));
+	serialTx.print(MCODE_UPDATE_FEEDER_CONFIG);
+	serialTx.print(F(" N"));
+	serialTx.print(this->feederNo);
+	serialTx.print(F(" A"));
+	serialTx.print(this->feederSettings.full_advanced_angle);
+	serialTx.print(F(" B"));
+	serialTx.print(this->feederSettings.half_advanced_angle);
+	serialTx.print(F(" C"));
+	serialTx.print(this->feederSettings.retract_angle);
+	serialTx.print(F(" F"));
+	serialTx.print(this->feederSettings.feed_length);
+	serialTx.print(F(" S"));
+	serialTx.print((float)this->feederSettings.advance_angle_speed/256, 3);
+	serialTx.print(F(" R"));
+	serialTx.print((float)this->feederSettings.retract_angle_speed/256, 3);
+	serialTx.print(F(" P"));
+	serialTx.print((float)this->feederSettings.advance_angle_acceleration/4096, 4);
+	serialTx.print(F(" Q"));
+	serialTx.print((float)this->feederSettings.retract_angle_acceleration/4096, 4);
+	serialTx.print(F(" U"));
+	serialTx.print(this->feederSettings.time_to_settle);
+	serialTx.print(F(" V"));
+	serialTx.print(this->feederSettings.motor_min_pulsewidth);
+	serialTx.print(F(" W"));
+	serialTx.print(this->feederSettings.motor_max_pulsewidth);
+	serialTx.print(F(" X"));
+	serialTx.print(this->feederSettings.ignore_feedback);
+	serialTx.print(F(" Y"));
+	serialTx.print(this->feederSettings.prefeed);
+	serialTx.println();
+}
+
+ServoControllerClass &FeederClass::servoController() {
+	return servoControllers[feederController(this->feederNo)];
+}
+
+uint8_t FeederClass::servoChannel() {
+	return feederChannel(this->feederNo);
+}
+
+void FeederClass::setup(ServoControllerClass *controllerList) {
 	//load settings from eeprom
-	this->loadFeederSettings();
+	if (!this->loadFeederSettings()) {
+		serialTx.print(F("Feeder "));
+		serialTx.print(this->feederNo);
+		serialTx.println(F(": no valid settings in EEPROM, defaults loaded"));
+		this->saveFeederSettings();
+	}
 
 	//attach servo to pin, after settings are loaded
-	Serial.println("Feeder " + String(this->feederNo) + " assigned to controller " + String((uint8_t) trunc((double) this->feederNo / 16.0)));
+	#ifdef DEBUG
+		serialTx.print(F("Feeder "));
+		serialTx.print(this->feederNo);
+		serialTx.print(F(" assigned to controller "));
+		serialTx.print(feederController(this->feederNo));
+		serialTx.print(F(" channel "));
+		serialTx.println(this->servoChannel());
+	#endif
+
+	servoControllers = controllerList;
+
+	//the lever is where it was left at the last power off, if that was saved
+	this->restoreLastPosition();
+
+	if (this->feederPosition == sAT_RETRACT_POSITION) {
+		//already there: just output the position, nothing moves or needs to settle
+		this->gotoAngle(this->feederSettings.retract_angle);
+		this->feederPosition = sAT_RETRACT_POSITION;
+	} else {
+		//put on defined position
+		this->gotoRetractPosition();
+	}
+}
 
-	this->servoController = &controllerList[(uint8_t) trunc((double) this->feederNo / 16.0)];
+uint16_t FeederClass::lastPositionAddress() {
+	return EEPROM_FEEDER_POSITION_ADDRESS_OFFSET + this->feederNo;
+}
+
+//take over the position saved by persistPosition(), if any. otherwise the lever position stays unknown
+void FeederClass::restoreLastPosition() {
+	uint8_t angle;
+
+	switch (EEPROM.read(this->lastPositionAddress())) {
+		case sAT_FULL_ADVANCED_POSITION:
+			angle = this->feederSettings.full_advanced_angle;
+			this->feederPosition = sAT_FULL_ADVANCED_POSITION;
+			break;
+		case sAT_HALF_ADVANCED_POSITION:
+			angle = this->feederSettings.half_advanced_angle;
+			this->feederPosition = sAT_HALF_ADVANCED_POSITION;
+			break;
+		case sAT_RETRACT_POSITION:
+			angle = this->feederSettings.retract_angle;
+			this->feederPosition = sAT_RETRACT_POSITION;
+			break;
+		case sAT_UNLOAD_POSITION:
+			angle = 0;
+			this->feederPosition = sAT_UNLOAD_POSITION;
+			break;
+		default:
+			return;
+	}
+
+	this->position() = (uint16_t)angle << 8;
+	this->targetPosition() = this->position();
+}
 
-	//put on defined position
-	this->gotoRetractPosition();
+/**
+* Save the lever position for the next start, only where a feeder rests: disabled, unloaded (M603) or back at
+* retract for FEEDER_POSITION_PERSIST_IDLE_MS. Positions in between while picking are not saved, and the cell is
+* only written if the position changed: feeders that always come back to retract do not write it at all.
+* Returns true if it was written.
+*/
+bool FeederClass::persistPosition(unsigned long now) {
+	uint8_t lastPosition;
+
+	if (this->feederState() == sDISABLED) {
+		//disabled while moving: the lever is somewhere in between
+		lastPosition = (this->position() == this->targetPosition()) ? this->feederPosition : sAT_UNKNOWN;
+	} else if (this->feederState() == sIDLE && this->position() == this->targetPosition()) {
+		if (this->feederPosition == sAT_RETRACT_POSITION) {
+			//16 bit time: once in 65 s the idle time wraps and looks short again for a while, the position was saved before
+			if ((uint16_t)((uint16_t)now - this->lastTimePositionChange()) < FEEDER_POSITION_PERSIST_IDLE_MS)
+				return false;
+		} else if (this->feederPosition != sAT_UNLOAD_POSITION) {
+			return false;
+		}
+		lastPosition = this->feederPosition;
+	} else {
+		return false;
+	}
+
+	//read first: this runs all the time, and every EEPROM.update() counts against the library's allowed writes
+	if (EEPROM.read(this->lastPositionAddress()) == lastPosition)
+		return false;
+	return EEPROM.write(this->lastPositionAddress(), lastPosition);
 }
 
 FeederClass::sFeederSettings FeederClass::getSettings() {
@@ -67,114 +203,268 @@ FeederClass::sFeederSettings FeederClass::getSettings() {
 
 void FeederClass::setSettings(sFeederSettings UpdatedFeederSettings) {
 	this->feederSettings=UpdatedFeederSettings;
+	this->updatePWMConversion();
 
 
 	#ifdef DEBUG
-		Serial.println(F("updated feeder settings"));
+		serialTx.println(F("updated feeder settings"));
 		this->outputCurrentSettings();
 	#endif
 }
 
-void FeederClass::loadFeederSettings() {
-	uint16_t adressOfFeederSettingsInEEPROM = EEPROM_FEEDER_SETTINGS_ADDRESS_OFFSET + this->feederNo * sizeof(this->feederSettings);
-	EEPROM.readBlock(adressOfFeederSettingsInEEPROM, this->feederSettings);
+//dallas/maxim crc8, as _crc_ibutton_update() of avr-libc
+static uint8_t crc8Update(uint8_t crc, uint8_t data) {
+	crc ^= data;
+	for (uint8_t i = 0; i < 8; i++)
+		crc = (crc & 1) ? (crc >> 1) ^ 0x8C : (crc >> 1);
+	return crc;
+}
+
+uint16_t FeederClass::settingsRecordAddress() {
+	return EEPROM_FEEDER_SETTINGS_ADDRESS_OFFSET + this->feederNo * FEEDER_SETTINGS_RECORD_SLOT;
+}
+
+//byte /offset/ of the eeprom record of the current settings
+uint8_t FeederClass::settingsRecordByte(uint8_t offset) {
+	const uint8_t *settings = (const uint8_t *)&this->feederSettings;
+
+	if (offset == 0)
+		return FEEDER_SETTINGS_SCHEMA;
+	if (offset == 1)
+		return sizeof(this->feederSettings);
+	if (offset < FEEDER_SETTINGS_RECORD_SIZE - 1)
+		return settings[offset - 2];
+
+	uint8_t crc = 0;
+	for (uint8_t i = 0; i < FEEDER_SETTINGS_RECORD_SIZE - 1; i++)
+		crc = crc8Update(crc, this->settingsRecordByte(i));
+	return crc;
+}
+
+/**
+* Load the settings record of this feeder. A record of an older firmware (shorter settings) keeps the
+* defaults for the fields it does not have and is rewritten behind. Returns false, with the settings
+* left as they are, if the record is missing or damaged (schema, length or crc do not match).
+*/
+bool FeederClass::loadFeederSettings() {
+	uint16_t address = this->settingsRecordAddress();
+	uint8_t schema = EEPROM.read(address);
+	uint8_t length = EEPROM.read(address + 1);
+
+	if (schema != FEEDER_SETTINGS_SCHEMA || length == 0 || length > FEEDER_SETTINGS_RECORD_SLOT - 3) {
+		return false;
+	}
+
+	uint8_t crc = crc8Update(crc8Update(0, schema), length);
+	sFeederSettings loaded = this->feederSettings;
+	uint8_t *settings = (uint8_t *)&loaded;
+
+	for (uint8_t i = 0; i < length; i++) {
+		uint8_t value = EEPROM.read(address + 2 + i);
+		crc = crc8Update(crc, value);
+		//fields of a newer firmware are dropped
+		if (i < sizeof(loaded))
+			settings[i] = value;
+	}
+
+	if (crc != EEPROM.read(address + 2 + length)) {
+		return false;
+	}
+
+	this->feederSettings = loaded;
+	this->updatePWMConversion();
+
+	//migrate in place: record gets the fields added since it was written
+	if (length < sizeof(this->feederSettings))
+		this->saveFeederSettings();
 
 	#ifdef DEBUG
-		Serial.println(F("loaded settings from eeprom:"));
+		serialTx.println(F("loaded settings from eeprom:"));
 		this->outputCurrentSettings();
 	#endif
+
+	return true;
 }
 
-void FeederClass::saveFeederSettings() {
-	uint16_t adressOfFeederSettingsInEEPROM = EEPROM_FEEDER_SETTINGS_ADDRESS_OFFSET + this->feederNo * sizeof(this->feederSettings);
-	EEPROM.writeBlock(adressOfFeederSettingsInEEPROM, this->feederSettings);
+//settings as stored before records: plain sFeederSettings of /legacySize/ bytes per feeder. fields it does not have keep their defaults
+void FeederClass::loadLegacyFeederSettings(uint8_t legacySize) {
+	uint16_t address = EEPROM_FEEDER_SETTINGS_ADDRESS_OFFSET + this->feederNo * legacySize;
+	uint8_t *settings = (uint8_t *)&this->feederSettings;
 
+	for (uint8_t i = 0; i < legacySize && i < sizeof(this->feederSettings); i++)
+		settings[i] = EEPROM.read(address + i);
+
+	this->updatePWMConversion();
+}
+
+//only marks the settings as unsaved, they are written to eeprom behind by the loop (or on M623)
+void FeederClass::saveFeederSettings() {
+	unsavedSettings[this->feederNo >> 3] |= (uint8_t)1 << (this->feederNo & 7);
 
 	#ifdef DEBUG
-		Serial.println(F("stored settings to eeprom:"));
+		serialTx.println(F("settings queued for eeprom:"));
 		this->outputCurrentSettings();
 	#endif
 }
 
+/**
+* Write-behind step: compare up to /maxCompares/ bytes of the eeprom record from /offset/ on and
+* program the first one that differs. Returns the offset to go on from, FEEDER_SETTINGS_RECORD_SIZE
+* once the record is up to date. Call only if EEPROM.isReady(), so it never waits.
+* The crc is the last byte, a record torn by a power loss is detected on the next start.
+*/
+uint8_t FeederClass::persistSettingsFrom(uint8_t offset, uint8_t maxCompares) {
+	uint16_t address = this->settingsRecordAddress();
+
+	for (; offset < FEEDER_SETTINGS_RECORD_SIZE && maxCompares > 0; offset++, maxCompares--) {
+		uint8_t value = this->settingsRecordByte(offset);
+		if (EEPROM.read(address + offset) != value) {
+			EEPROM.write(address + offset, value);
+			return offset + 1;
+		}
+	}
+
+	return offset;
+}
+
+//write the settings record to eeprom now, changed bytes only. returns the number of bytes written
+uint8_t FeederClass::commitSettings() {
+	uint16_t address = this->settingsRecordAddress();
+	uint8_t bytesWritten = 0;
+	unsavedSettings[this->feederNo >> 3] &= ~((uint8_t)1 << (this->feederNo & 7));
+
+	for (uint8_t offset = 0; offset < FEEDER_SETTINGS_RECORD_SIZE; offset++) {
+		if (EEPROM.update(address + offset, this->settingsRecordByte(offset)))
+			bytesWritten++;
+	}
+
+	return bytesWritten;
+}
+
 void FeederClass::factoryReset() {
-	//just save the defaults to eeprom...
+	//just save the defaults to eeprom, right away: they are loaded again by setup()
 
-	this->saveFeederSettings();
+	this->commitSettings();
 }
 
 
 void FeederClass::gotoPostPickPosition() {
-  if ((this->feederPosition==sAT_FULL_ADVANCED_POSITION) || 
+  if (this->prefedLength > 0) {
+    //a pre-feed running or its part not taken by an advance yet: nothing was picked since
+    #ifdef DEBUG
+      serialTx.println(F("gotoPostPickPosition kept the pre-fed part"));
+    #endif
+  } else if (this->feederSettings.prefeed == 1 && this->feederSettings.feed_length > 0 &&
+  	  ((this->feederPosition==sAT_FULL_ADVANCED_POSITION) || (this->feederPosition==sAT_RETRACT_POSITION)) &&
+  	  this->feederState()==sIDLE && this->advanceQueueCount==0 && this->feederIsOk()) {
+    this->prefeed();
+  } else if ((this->feederPosition==sAT_FULL_ADVANCED_POSITION) || 
   	  (this->feederPosition==sAT_UNLOAD_POSITION)) {
     this->gotoRetractPosition();
     #ifdef DEBUG
-      Serial.println("gotoPostPickPosition retracted feeder");
+      serialTx.println(F("gotoPostPickPosition retracted feeder"));
     #endif
   } else {
     #ifdef DEBUG
-      Serial.println("gotoPostPickPosition didn't need to retract feeder");
+      serialTx.println(F("gotoPostPickPosition didn't need to retract feeder"));
     #endif
 
   }
 }
 
+/**
+* Feed the next part right after the pick: the advance cycle of the default feed length starts now, with
+* the retract as its first move. Nobody waits for it, the next advance takes the part instead of feeding
+* and answers at once, or once the cycle settled if it still runs (see advance()).
+*/
+void FeederClass::prefeed() {
+	this->prefedLength = this->feederSettings.feed_length;
+	this->remainingFeedLength = this->prefedLength;
+	setFeederBit(motion.prefeedInProgress, this->feederNo);
+	clearFeederBit(motion.advanceInBatch, this->feederNo);
+	this->startCycle(this->remainingFeedLength);
+	this->advanceNext();
+	#ifdef DEBUG
+		serialTx.println(F("gotoPostPickPosition started pre-feed"));
+	#endif
+}
+
+//the tape moved otherwise or the lever lost its position: forget the pre-fed part. a running pre-feed stops after its current move
+void FeederClass::clearPrefeed() {
+	if (isFeederBitSet(motion.prefeedInProgress, this->feederNo)) {
+		clearFeederBit(motion.prefeedInProgress, this->feederNo);
+		clearFeederBit(motion.advanceInProgress, this->feederNo);
+		this->remainingFeedLength = 0;
+	}
+	this->prefedLength = 0;
+}
+
 void FeederClass::gotoRetractPosition() {
 	this->startMove(this->feederSettings.retract_angle,sAT_RETRACT_POSITION);
 	#ifdef DEBUG
-		Serial.println("going to retract now");
+		serialTx.println(F("going to retract now"));
 	#endif
 }
 
 void FeederClass::gotoHalfAdvancedPosition() {
 	this->startMove(this->feederSettings.half_advanced_angle,sAT_HALF_ADVANCED_POSITION);
 	#ifdef DEBUG
-		Serial.println("going to half adv now");
+		serialTx.println(F("going to half adv now"));
 	#endif
 }
 
 void FeederClass::gotoFullAdvancedPosition() {
 	this->startMove(this->feederSettings.full_advanced_angle,sAT_FULL_ADVANCED_POSITION);
 	#ifdef DEBUG
-		Serial.println("going to full adv now");
+		serialTx.println(F("going to full adv now"));
 	#endif
 }
 
 void FeederClass::gotoUnloadPosition() {
+	this->clearPrefeed();
 	this->startMove(0,sAT_UNLOAD_POSITION);
 	#ifdef DEBUG
-		Serial.println("going to unload now");
+		serialTx.println(F("going to unload now"));
 	#endif
 }
 
+//lever to any angle (M603): none of the positions an advance knows, the next one retracts first
 void FeederClass::gotoAngle(uint8_t angle) {
-	
-	this->position = (uint16_t)angle << 8;
-	this->targetPosition = this->position;
+	this->clearPrefeed();
+	this->feederPosition = sAT_UNKNOWN;
+	this->position() = (uint16_t)angle << 8;
+	this->targetPosition() = this->position();
+	motion.velocity[this->feederNo] = 0;
+	motion.rampDistance[this->feederNo] = 0;
+	motion.positionFraction[this->feederNo] = 0;
 	#ifdef DEBUG
-	Serial.println("Moving feeder " + String(this->feederNo) + " to angle " + String(angle));	
+	serialTx.print(F("Moving feeder "));
+	serialTx.print(this->feederNo);
+	serialTx.print(F(" to angle "));
+	serialTx.println(angle);
 	#endif // DEBUG
-	this->servoController->setChannelPWM(this->feederNo, map(angle, 0, 180, this->feederSettings.motor_min_pulsewidth, this->feederSettings.motor_max_pulsewidth));
+	this->servoController().setChannelPWM(this->servoChannel(), this->positionToPWM(this->position()));
 	
 	#ifdef DEBUG
-		Serial.print("going to ");
-		Serial.print(angle);
-		Serial.println("deg");
+		serialTx.print(F("going to "));
+		serialTx.print(angle);
+		serialTx.println(F("deg"));
 	#endif
 }
 
-bool FeederClass::advance(uint8_t feedLength, bool overrideError = false) {
+bool FeederClass::advance(uint8_t feedLength, bool overrideError, bool inBatch) {
 
 	#ifdef DEBUG
-		Serial.println(F("advance triggered"));
-		Serial.println(this->reportFeederErrorState());
+		serialTx.println(F("advance triggered"));
+		serialTx.println(this->reportFeederErrorState());
 	#endif
 	
 	
 	#ifdef DEBUG
-		Serial.print(F("feederIsOk: "));
-		Serial.println(this->feederIsOk());
-		Serial.print(F("overrideError: "));
-		Serial.println(overrideError);
+		serialTx.print(F("feederIsOk: "));
+		serialTx.println(this->feederIsOk());
+		serialTx.print(F("overrideError: "));
+		serialTx.println(overrideError);
 	#endif
 	
 	//check whether feeder is OK before every advance command
@@ -184,39 +474,94 @@ bool FeederClass::advance(uint8_t feedLength, bool overrideError = false) {
 		 if(!overrideError) {
 			//return with false means an error, that is not ignored/overridden
 			//error, and error was not overridden -> return false, advance not successful
+			#ifdef FEEDER_STATS
+				if(this->stats.errors != 255)
+					this->stats.errors++;
+			#endif
 			return false;
 		 } else {
 			#ifdef DEBUG
-				Serial.println(F("overridden error temporarily"));
+				serialTx.println(F("overridden error temporarily"));
 			#endif
 			 
 		 }
 	}
 
+	//a part pre-fed after the last pick counts towards this advance, only the rest is fed
+	if(feedLength>0 && this->prefedLength>0) {
+		uint8_t rest = (feedLength > this->prefedLength) ? feedLength - this->prefedLength : 0;
+		this->prefedLength = 0;
+
+		if(isFeederBitSet(motion.prefeedInProgress, this->feederNo)) {
+			//still moving: the pre-feed becomes this advance and answers when it settled
+			clearFeederBit(motion.prefeedInProgress, this->feederNo);
+			if(inBatch) {
+				setFeederBit(motion.advanceInBatch, this->feederNo);
+				setFeederBit(motion.batchAdvancePending, this->feederNo);
+			}
+			if(rest>0) {
+				this->remainingFeedLength += rest;
+				clearFeederBit(motion.advanceInProgress, this->feederNo);
+			}
+			return true;
+		}
+
+		if(rest==0) {
+			//part presented already
+			#ifdef DEBUG
+				serialTx.println(F("advance answered by the pre-fed part"));
+			#endif
+			if(!inBatch)
+				serialTx.println(F("ok, advancing cycle completed"));
+			return true;
+		}
+		feedLength = rest;
+	}
+
 	//check, what to do? if not, return quickly
 	if(feedLength==0) {
 		//nothing to do, just return
 		#ifdef DEBUG
-			Serial.println(F("advance ignored, 0 feedlength was given"));
+			serialTx.println(F("advance ignored, 0 feedlength was given"));
 		#endif
-	} else if ( feedLength>0 && this->feederState!=sIDLE ) {
-		//last advancing not completed! ignore newly received command
-		//TODO: one could use a queue
+	} else if ( feedLength>0 && this->feederState()!=sIDLE ) {
+		//last advancing not completed! queue newly received command, update() starts it once the feeder settled
+		if(this->advanceQueueIsFull()) {
+			#ifdef DEBUG
+				serialTx.println(F("advance rejected, queue full"));
+			#endif
+			this->recordBusy();
+			return false;
+		}
+
+		this->advanceQueue[(this->advanceQueueHead + this->advanceQueueCount) % FEEDER_ADVANCE_QUEUE_LENGTH] = feedLength | (inBatch ? FEEDER_ADVANCE_QUEUE_BATCH : 0);
+		this->advanceQueueCount++;
+		if(inBatch)
+			setFeederBit(motion.batchAdvancePending, this->feederNo);
+
 		#ifdef DEBUG
-		
-			Serial.print(F("advance ignored, feedlength>0 given, but feederState!=sIDLE"));
-			Serial.print(F(" (feederState="));
-			Serial.print(this->feederState);
-			Serial.println(F(")"));
+			serialTx.print(F("advance queued, feederState!=sIDLE"));
+			serialTx.print(F(" (feederState="));
+			serialTx.print(this->feederState());
+			serialTx.print(F(", queued="));
+			serialTx.print(this->advanceQueueCount);
+			serialTx.println(F(")"));
 		#endif
 	} else {
 		//OK, start new advance-proc
 		//feed multiples of 2 possible: 2/4/6/8/10/12,...
 		#ifdef DEBUG
-			Serial.print(F("advance initialized, remainingFeedLength="));
-			Serial.println(feedLength);
+			serialTx.print(F("advance initialized, remainingFeedLength="));
+			serialTx.println(feedLength);
 		#endif
 		this->remainingFeedLength=feedLength;
+		if(inBatch) {
+			setFeederBit(motion.advanceInBatch, this->feederNo);
+			setFeederBit(motion.batchAdvancePending, this->feederNo);
+		} else {
+			clearFeederBit(motion.advanceInBatch, this->feederNo);
+		}
+		this->startCycle(feedLength);
 		this->advanceNext();
 	}
 
@@ -226,8 +571,8 @@ bool FeederClass::advance(uint8_t feedLength, bool overrideError = false) {
 
 void FeederClass::advanceNext() {
 	#ifdef DEBUG
-		Serial.print("remainingFeedLength before working: ");
-		Serial.println(this->remainingFeedLength);
+		serialTx.print(F("remainingFeedLength before working: "));
+		serialTx.println(this->remainingFeedLength);
 	#endif
 	switch (this->feederPosition) {
 		/* ------------------------------------- UNLOAD AND RETRACT POS ---------------------- */
@@ -256,7 +601,8 @@ void FeederClass::advanceNext() {
 		}
 		break;
 
-		/* ------------------------------------- FULL-ADVANCED POS ---------------------- */
+		/* ------------------------------------- FULL-ADVANCED OR UNKNOWN POS ---------------------- */
+		case sAT_UNKNOWN:
 		case sAT_FULL_ADVANCED_POSITION: {
 	// if coming here and remainingFeedLength==0, then the function is aborted above already, thus no retract after pick
 	// if coming here and remainingFeedLength >0, then the feeder goes to retract for next advance move
@@ -272,50 +618,225 @@ void FeederClass::advanceNext() {
 	}
 
 	#ifdef DEBUG
-		Serial.print("remainingFeedLength after working: ");
-		Serial.println(this->remainingFeedLength);
+		serialTx.print(F("remainingFeedLength after working: "));
+		serialTx.println(this->remainingFeedLength);
 	#endif
 	//just finished advancing? set flag to send ok in next run after settle-time to let the pnp go on
 	if(this->remainingFeedLength==0) {
-		this->advanceInProgress = true;
+		setFeederBit(motion.advanceInProgress, this->feederNo);
 	}
 }
 
+bool FeederClass::advanceQueueIsFull() {
+	return this->advanceQueueCount >= FEEDER_ADVANCE_QUEUE_LENGTH;
+}
+
+void FeederClass::clearAdvanceQueue() {
+	#ifdef FEEDER_STATS
+		this->stats.dropped = (this->stats.dropped + this->advanceQueueCount > 255) ? 255 : this->stats.dropped + this->advanceQueueCount;
+	#endif
+	this->advanceQueueHead = 0;
+	this->advanceQueueCount = 0;
+	if (this->batchAdvancePending())
+		setFeederBit(motion.batchAdvanceAborted, this->feederNo);
+	clearFeederBit(motion.advanceInBatch, this->feederNo);
+	clearFeederBit(motion.batchAdvancePending, this->feederNo);
+}
+
+//an advance cycle begins (at once or from the queue)
+void FeederClass::startCycle(uint8_t feedLength) {
+	#ifdef FEEDER_STATS
+		this->cycleStart = (uint16_t)motionTime();
+		if (this->stats.advances != 65535)
+			this->stats.advances++;
+		if (this->stats.fed <= 65535 - feedLength / 2)
+			this->stats.fed += feedLength / 2;
+	#else
+		(void)feedLength;
+	#endif
+}
+
+//advance refused, queue full. counted here as the queue is checked by the caller, too
+void FeederClass::recordBusy() {
+	#ifdef FEEDER_STATS
+		if (this->stats.busy != 255)
+			this->stats.busy++;
+	#endif
+}
+
+#ifdef FEEDER_STATS
+//moving average over about 8 samples in 1/16 ms, the first sample is taken as is
+static uint16_t updateAverage(uint16_t average, uint16_t ms, bool first) {
+	uint16_t sample = (ms > 4095) ? 65535 : ms << 4;
+	if (first)
+		return sample;
+	return average + ((int32_t)sample - average) / 8;
+}
+
+void FeederClass::outputStats() {
+	serialTx.print(F("N"));
+	serialTx.print(this->feederNo);
+	serialTx.print(F(" advances="));
+	serialTx.print(this->stats.advances);
+	serialTx.print(F(" fed="));
+	serialTx.print((uint32_t)this->stats.fed * 2);
+	serialTx.print(F("mm cycle="));
+	serialTx.print(this->stats.cycleMin);
+	serialTx.print('/');
+	serialTx.print(this->stats.cycleAverage >> 4);
+	serialTx.print('/');
+	serialTx.print(this->stats.cycleMax);
+	serialTx.print(F("ms stroke="));
+	serialTx.print(this->stats.advanceStrokeAverage >> 4);
+	serialTx.print('/');
+	serialTx.print(this->stats.retractStrokeAverage >> 4);
+	serialTx.print(F("ms overruns="));
+	serialTx.print(this->stats.settleOverruns);
+	serialTx.print(F(" errors="));
+	serialTx.print(this->stats.errors);
+	serialTx.print(F(" busy="));
+	serialTx.print(this->stats.busy);
+	serialTx.print(F(" dropped="));
+	serialTx.println(this->stats.dropped);
+}
+
+void FeederClass::resetStats() {
+	memset(&this->stats, 0, sizeof(this->stats));
+}
+#endif
+
+void FeederClass::setActive() {
+	activeFeeders[this->feederNo >> 3] |= (uint8_t)1 << (this->feederNo & 7);
+}
+
 void FeederClass::startMove(uint8_t angle, sFeederPosition pos) {
-	this->targetPosition = (uint16_t)angle << 8;
+	this->setActive();
+	this->targetPosition() = (uint16_t)angle << 8;
 	this->feederPosition = pos;
-	this->feederState = sMOVING;
-	this->lastTimePositionChange = millis();
+	//every move starts from standstill
+	motion.velocity[this->feederNo] = 0;
+	motion.rampDistance[this->feederNo] = 0;
+	motion.positionFraction[this->feederNo] = 0;
+	this->feederState() = sMOVING;
+	unsigned long now = motionTime();
+	this->lastTimePositionChange() = now;
+
+	//a move changing its target keeps its admission. nothing to move draws no current
+	if (!isFeederBitSet(motion.moveAdmitted, this->feederNo) && this->position() != this->targetPosition()) {
+		if (!admitMove(now)) {
+			//update() starts it once admitted, lastTimePositionChange tells since when it waits
+			delayedMoves++;
+			return;
+		}
+		setFeederBit(motion.moveAdmitted, this->feederNo);
+	}
+
+	#ifdef FEEDER_STATS
+		this->strokeStart = this->lastTimePositionChange();
+	#endif
+
 	this->moveServoToTarget(1);
 }
 
+//take the current of one more moving servo, if the budget and the start stagger allow it now
+bool FeederClass::admitMove(unsigned long now) {
+	if (MOTION_CURRENT_BUDGET_MA > 0 && movingCurrent + MOTION_MOVE_CURRENT_MA > MOTION_CURRENT_BUDGET_MA)
+		return false;
+
+	if (MOTION_START_STAGGER_MS > 0 && movingCurrent > 0 && now - lastMoveAdmitted < MOTION_START_STAGGER_MS)
+		return false;
+
+	movingCurrent += MOTION_MOVE_CURRENT_MA;
+	lastMoveAdmitted = now;
+	if (movingCurrent > peakMovingCurrent)
+		peakMovingCurrent = movingCurrent;
+	return true;
+}
+
+//move finished or aborted: give back its current
+void FeederClass::releaseMove() {
+	if (!isFeederBitSet(motion.moveAdmitted, this->feederNo))
+		return;
+
+	clearFeederBit(motion.moveAdmitted, this->feederNo);
+	movingCurrent -= MOTION_MOVE_CURRENT_MA;
+}
+
 bool FeederClass::moveServoToTarget(uint8_t ms) {
-	uint8_t posOld = this->position >> 8;
-	if (posOld == 0)	// Force move at angle=0
-		posOld = 255;
+	//work on copies of this feeder's motion entries, written back once
+	uint8_t n = this->feederNo;
+	uint16_t position = motion.position[n];
+	uint16_t targetPosition = motion.targetPosition[n];
+
 	while (ms--) {
-		if (this->position < this->targetPosition) {
-			uint16_t delta = this->targetPosition - this->position;
-			if ((this->feederSettings.advance_angle_speed > 0) && (delta > this->feederSettings.advance_angle_speed))
+		if (position < targetPosition) {
+			uint16_t delta = targetPosition - position;
+			if (this->feederSettings.advance_angle_acceleration > 0)
+				delta=nextProfileStep(n, delta, this->feederSettings.advance_angle_speed, this->feederSettings.advance_angle_acceleration);
+			else if ((this->feederSettings.advance_angle_speed > 0) && (delta > this->feederSettings.advance_angle_speed))
 				delta=this->feederSettings.advance_angle_speed;
-			this->position += delta;
-		} else if (this->position > this->targetPosition) {
-			uint16_t delta = this->position - this->targetPosition;
-			if ((this->feederSettings.retract_angle_speed > 0) && (delta > this->feederSettings.retract_angle_speed))
+			position += delta;
+		} else if (position > targetPosition) {
+			uint16_t delta = position - targetPosition;
+			if (this->feederSettings.retract_angle_acceleration > 0)
+				delta=nextProfileStep(n, delta, this->feederSettings.retract_angle_speed, this->feederSettings.retract_angle_acceleration);
+			else if ((this->feederSettings.retract_angle_speed > 0) && (delta > this->feederSettings.retract_angle_speed))
 				delta=this->feederSettings.retract_angle_speed;
-			this->position -= delta;
+			position -= delta;
 		} else {
 			break;
 		}
 	}
-	uint8_t posNow = this->position >> 8;
-	if (posNow != posOld)
-	#ifdef DEBUG
-		Serial.println("Moving feeder " + String(this->feederNo) + " to position " + String(posNow));
-	#endif // DEBUG
-		this->servoController->setChannelPWM(this->feederNo, map(posNow, 0, 180, this->feederSettings.motor_min_pulsewidth, this->feederSettings.motor_max_pulsewidth));
-		// delay(1);
-	return this->position != this->targetPosition;
+	motion.position[n] = position;
+
+	//sub-degree output, the controller only goes on the bus if the count really changed
+	this->servoController().setChannelPWM(this->servoChannel(), this->positionToPWM(position));
+	return position != targetPosition;
+}
+
+/*
+*  One ms of a trapezoidal move of feeder n: accelerate up to speed, cruise, and brake once the remaining distance
+*  is what it took to accelerate. Accelerating steps with the new velocity and braking steps with the
+*  old one, so both ramps cover the same distance and the move ends at target without creeping.
+*  distance: to target in 1/256 degree, speed in 1/256 degree/ms (0: no limit), acceleration in 1/4096 degree/ms².
+*  returns the distance to move in this ms in 1/256 degree.
+*/
+uint16_t FeederClass::nextProfileStep(uint8_t n, uint16_t distance, uint16_t speed, uint16_t acceleration) {
+	uint32_t maxVelocity = (speed == 0 || speed >= 4096) ? 65535 : (uint32_t)speed << 4;
+	uint16_t velocity = motion.velocity[n];
+	bool accelerating = false;
+	uint16_t stepVelocity;
+
+	if (distance <= motion.rampDistance[n]) {
+		//brake
+		stepVelocity = velocity;
+		velocity = ((uint32_t)velocity > 2 * (uint32_t)acceleration) ? velocity - acceleration : acceleration;
+	} else {
+		if (velocity < maxVelocity) {
+			uint32_t v = (uint32_t)velocity + acceleration;
+			velocity = (v > maxVelocity) ? maxVelocity : v;
+			accelerating = true;
+		}
+		stepVelocity = velocity;
+	}
+
+	uint32_t fine = (uint32_t)motion.positionFraction[n] + stepVelocity;
+	uint16_t delta = fine >> 4;
+
+	if (delta >= distance) {
+		//arrived
+		motion.velocity[n] = 0;
+		motion.rampDistance[n] = 0;
+		motion.positionFraction[n] = 0;
+		return distance;
+	}
+
+	motion.velocity[n] = velocity;
+	motion.positionFraction[n] = fine & 0x0F;
+	if (accelerating)
+		motion.rampDistance[n] += delta;
+
+	return delta;
 }
 
 bool FeederClass::feederIsOk() {
@@ -334,7 +855,7 @@ FeederClass::tFeederErrorState FeederClass::getFeederErrorState() {
 		return sOK_NOFEEDBACKLINE;
 	}
 
-	if( digitalRead((uint8_t)feederFeedbackPinMap[this->feederNo]) == LOW ) {
+	if( isFeederBitSet(feedbackLines, this->feederNo) ) {
 		//the microswitch pulls feedback-pin LOW if tension of cover tape is OK. motor to pull tape is off then
 		//no error
 		return sOK;
@@ -355,144 +876,159 @@ FeederClass::tFeederErrorState FeederClass::getFeederErrorState() {
 #endif
 }
 
-String FeederClass::reportFeederErrorState() {
+const __FlashStringHelper *FeederClass::reportFeederErrorState() {
 	switch(this->getFeederErrorState()) {
 		case sOK_NOFEEDBACKLINE:
-			return "getFeederErrorState: sOK_NOFEEDBACKLINE (no feedback line for feeder, impliciting feeder OK)";
+			return F("getFeederErrorState: sOK_NOFEEDBACKLINE (no feedback line for feeder, impliciting feeder OK)");
 		break;
 		case sOK:
-			return "getFeederErrorState: sOK (feedbackline checked, explicit feeder OK)";
+			return F("getFeederErrorState: sOK (feedbackline checked, explicit feeder OK)");
 		break;
 		case sERROR_IGNORED:
-			return "getFeederErrorState: sERROR_IGNORED (error, but ignored per feeder setting X1)";
+			return F("getFeederErrorState: sERROR_IGNORED (error, but ignored per feeder setting X1)");
 		break;
 		case sERROR:
-			return "getFeederErrorState: sERROR (error signaled on feedbackline)";
+			return F("getFeederErrorState: sERROR (error signaled on feedbackline)");
 		break;
 		
 		default:
-			return "illegal state in reportFeederErrorState";
+			return F("illegal state in reportFeederErrorState");
 	}
 }
 
 //called when M-Code to enable feeder is issued
 void FeederClass::enable() {
 	
-	this->feederState=sIDLE;
-	this->advanceInProgress = false;
+	this->feederState()=sIDLE;
+	this->clearPrefeed();
+	clearFeederBit(motion.advanceInProgress, this->feederNo);
+	this->clearAdvanceQueue();
+	this->releaseMove();
 	
-	this->servoController->setChannelOn(this->feederNo % 16);
-	this->servoController->setChannelPWM(this->feederNo % 16, 310);
+	//hold the lever where it is
+	this->servoController().setChannelPWM(this->servoChannel(), this->positionToPWM(this->position()));
 }
 
 //called when M-Code to disable feeder is issued
 void FeederClass::disable() {
   
-	this->feederState=sDISABLED;
+	this->feederState()=sDISABLED;
+	this->clearPrefeed();
+	this->clearAdvanceQueue();
+	this->releaseMove();
 	
-	this->servoController->setChannelOff(this->feederNo % 16);
+	this->servoController().setChannelOff(this->servoChannel());
 }
 
-void FeederClass::update() {
+//called by the loop for active feeders only, with the timestamp of this loop iteration.
+//returns false once the feeder has nothing left to do, it is then skipped until the next move.
+bool FeederClass::update(unsigned long now) {
+	uint16_t now16 = now;		//motion times are kept in 16 bit
 
-#ifdef HAS_FEEDBACKLINES
-	//routine for detecting manual feed via tensioner microswitch.
-	//useful for setup a feeder. press tensioner short to advance by feeder's default feed length
-	//feeder have to be enabled for this, otherwise this feature doesn't work and pressing the tensioner can't be detected due to open mosfet on controller pcb.
-	if(this->feederState==sIDLE) {		//only check feedback line if feeder is idle. this shall not interfere with the feedbackline-checking to detect the error state of the feeder
-		
-		if (millis() - this->lastTimeFeedbacklineCheck >= 10UL) {	//to debounce, check every 10ms the feedbackline.
-			
-			this->lastTimeFeedbacklineCheck=millis();		//update last time checked
-		
-			int buttonState = digitalRead(feederFeedbackPinMap[this->feederNo]);	//read level of feedbackline (active low)
-		
-			if ( this->feedbackLineTickCounter > 0 ) {		//to debounce there is a timer
-				this->feedbackLineTickCounter++;
-			}
-		
-			
-			if ( (buttonState != this->lastButtonState) && (buttonState == LOW)) {		//event: button state changed to low (tensioner pressed)
-				this->lastButtonState=buttonState;		//update state
-				this->feedbackLineTickCounter=1;		//start counter
-				#ifdef DEBUG
-					Serial.println(F("buttonState changed to low"));
-				#endif
-			} else if (buttonState != this->lastButtonState) {
-				this->lastButtonState=buttonState;	//update in case button went high again
-			}
-			
-			if ( (this->feedbackLineTickCounter > 5) ) {
-				//after 50ms the microswitch is expected to be debounced, so a potential manual feed can be issued, when going to high level again.
-				if(buttonState==HIGH) {
-					//button released, we have a valid feed command now
-					#ifdef DEBUG
-						Serial.print(F("Manual feed triggered for feeder N"));
-						Serial.print(this->feederNo);
-						Serial.print(F(", advancing feeders default length "));
-						Serial.print(this->feederSettings.feed_length);
-						Serial.println(F("mm."));
-					#endif
-					
-					//trigger feed with default feeder length, errors are overridden.
-					this->advance(this->feederSettings.feed_length,true);
-					
-					//reset
-					this->feedbackLineTickCounter=0;
-				}
-				
-				//check for invalidity
-				if (this->feedbackLineTickCounter > 50) {	//button pressed too long (this is the case, too, if the cover tape was inserted and properly tensioned)
-					
-					#ifdef DEBUG
-						Serial.println(F("Potential manual feed rejected (button pressed too long, probably cover tape was inserted properly)"));
-					#endif
-					
-					//reset counter to reject potential feed
-					this->feedbackLineTickCounter=0;
-				}
-			}
-		}
-		return;
-	} else {
-		//permanently reset vars to don't do anything if not idle...
-		this->lastButtonState = digitalRead(feederFeedbackPinMap[this->feederNo]);	//read level of feedbackline (active low)
-		feedbackLineTickCounter=0;
-	}
-#else
-	if (this->feederState==sIDLE)
-		return;
-#endif
+	//manual feeds on the feedback line are detected for all feeders at once, see FeedbackLines.h
+	if (this->feederState()==sIDLE)
+		return false;
   
-	if (this->feederState==sMOVING) {	// Move in progress
-		uint8_t dt = millis() - this->lastTimePositionChange;
+	if (this->feederState()==sMOVING) {	// Move in progress
+		if (!isFeederBitSet(motion.moveAdmitted, this->feederNo) && this->position() != this->targetPosition()) {
+			//waiting for admission
+			if (!admitMove(now))
+				return true;
+
+			uint16_t wait = now16 - this->lastTimePositionChange();
+			if (wait > maxAdmissionWait)
+				maxAdmissionWait = wait;
+			setFeederBit(motion.moveAdmitted, this->feederNo);
+			this->lastTimePositionChange() = now16;
+			#ifdef FEEDER_STATS
+				this->strokeStart = now16;
+			#endif
+		}
+
+		uint16_t dt = now16 - this->lastTimePositionChange();
 		if (dt == 0)
-			return;
-		this->lastTimePositionChange += dt;
+			return true;
+		//after a very long loop iteration catch up in steps of 255 ms
+		if (dt > 255)
+			dt = 255;
+		this->lastTimePositionChange() += dt;
 		if (this->moveServoToTarget(dt))
-			return;
-		this->feederState=sSETTLE;
+			return true;
+		this->releaseMove();
+		this->feederState()=sSETTLE;
+
+		#ifdef FEEDER_STATS
+			uint16_t stroke = this->lastTimePositionChange() - this->strokeStart;
+			if (this->feederPosition == sAT_RETRACT_POSITION)
+				this->stats.retractStrokeAverage = updateAverage(this->stats.retractStrokeAverage, stroke, this->stats.retractStrokeAverage == 0);
+			else
+				this->stats.advanceStrokeAverage = updateAverage(this->stats.advanceStrokeAverage, stroke, this->stats.advanceStrokeAverage == 0);
+		#endif
 	}
 
 	//time to change the position?
-	if (millis() - this->lastTimePositionChange >= (unsigned long)this->feederSettings.time_to_settle) {
+	uint16_t sinceChange = now16 - this->lastTimePositionChange();
+	if (sinceChange >= (uint16_t)this->feederSettings.time_to_settle) {
 
 		//now servo is expected to have settled at its designated position, so do some stuff
-		if(this->advanceInProgress) {
-			this->advanceInProgress = false;
-			Serial.println("ok, advancing cycle completed");
+		#ifdef FEEDER_STATS
+			if (this->feederState() == sSETTLE && sinceChange - (uint16_t)this->feederSettings.time_to_settle > FEEDER_SETTLE_OVERRUN_MS && this->stats.settleOverruns != 255)
+				this->stats.settleOverruns++;
+		#endif
+
+		if(isFeederBitSet(motion.advanceInProgress, this->feederNo)) {
+			clearFeederBit(motion.advanceInProgress, this->feederNo);
+
+			#ifdef FEEDER_STATS
+				uint16_t cycle = (uint16_t)now - this->cycleStart;
+				bool firstCycle = (this->stats.cycleMax == 0);
+				if (firstCycle || cycle < this->stats.cycleMin)
+					this->stats.cycleMin = cycle;
+				if (cycle > this->stats.cycleMax)
+					this->stats.cycleMax = cycle;
+				this->stats.cycleAverage = updateAverage(this->stats.cycleAverage, cycle, firstCycle);
+			#endif
+			if(isFeederBitSet(motion.prefeedInProgress, this->feederNo)) {
+				//pre-feed done, no advance waits for it: the part is presented to the next one
+				clearFeederBit(motion.prefeedInProgress, this->feederNo);
+			} else if(isFeederBitSet(motion.advanceInBatch, this->feederNo)) {
+				//the batch answers once for all its feeders
+				clearFeederBit(motion.advanceInBatch, this->feederNo);
+				clearFeederBit(motion.batchAdvancePending, this->feederNo);
+			} else {
+				serialTx.println(F("ok, advancing cycle completed"));
+			}
+		}
+
+		//advance done, start the next queued one right away
+		if(this->remainingFeedLength==0 && this->advanceQueueCount>0 && this->feederState()!=sDISABLED) {
+			this->remainingFeedLength=this->advanceQueue[this->advanceQueueHead] & ~FEEDER_ADVANCE_QUEUE_BATCH;
+			if (this->advanceQueue[this->advanceQueueHead] & FEEDER_ADVANCE_QUEUE_BATCH)
+				setFeederBit(motion.advanceInBatch, this->feederNo);
+			else
+				clearFeederBit(motion.advanceInBatch, this->feederNo);
+			this->advanceQueueHead=(this->advanceQueueHead + 1) % FEEDER_ADVANCE_QUEUE_LENGTH;
+			this->advanceQueueCount--;
+			this->startCycle(this->remainingFeedLength);
+			#ifdef DEBUG
+				serialTx.print(F("queued advance started, remainingFeedLength="));
+				serialTx.println(this->remainingFeedLength);
+			#endif
 		}
 
 		//if no need for feeding exit fast.
 		if(this->remainingFeedLength==0) {
-			if(this->feederState!=sDISABLED)
+			if(this->feederState()!=sDISABLED)
 				//if feeder are not disabled:
 				//make sure sIDLE is entered always again (needed if gotoXXXPosition functions are called directly instead by advance() which would set a remainingFeedLength)
-				this->feederState=sIDLE;
+				this->feederState()=sIDLE;
 				
-			return;
+			return false;
 		}
-		this->feederState=sMOVING;
+		this->feederState()=sMOVING;
 		this->advanceNext();
 	}
+
+	//still moving or settling
+	return true;
 }
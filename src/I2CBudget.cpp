@@ -0,0 +1,73 @@
+#include "I2CBudget.h"
+#include "SerialTx.h"
+#include "I2CQueue.h"
+
+static unsigned long lastFlush = 0;
+static bool flushed = false;		// lastFlush is valid
+
+bool i2cFlushDue(unsigned long now) {
+	return !flushed || now - lastFlush >= I2C_FLUSH_INTERVAL_MS;
+}
+
+void i2cFlushDone(unsigned long now) {
+	lastFlush = now;
+	flushed = true;
+}
+
+#ifdef LATENCY_STATS
+
+static unsigned long frameStart = 0;		// [ms] start of the servo frame accounted in frameBusTime
+static unsigned long frameBusTime = 0;		// [µs]
+static unsigned long frameBusTimeMax = 0;	// [µs] of the busiest frame
+static uint16_t framesOverBudget = 0;		// frames with more than I2C_BUS_BUDGET_PERCENT of bus time
+
+//called from the I²C interrupt, when a burst is done
+void i2cBudgetRecord(unsigned long us) {
+	unsigned long now = millis();
+
+	if (now - frameStart >= SERVO_FRAME_MS) {
+		frameStart = now - (now - frameStart) % SERVO_FRAME_MS;
+		frameBusTime = 0;
+	}
+
+	//count a frame once, when it crosses the budget
+	bool overBudget = frameBusTime * 100 > (unsigned long)SERVO_FRAME_MS * 1000 * I2C_BUS_BUDGET_PERCENT;
+	frameBusTime += us;
+	if (!overBudget && frameBusTime * 100 > (unsigned long)SERVO_FRAME_MS * 1000 * I2C_BUS_BUDGET_PERCENT && framesOverBudget != 65535)
+		framesOverBudget++;
+
+	if (frameBusTime > frameBusTimeMax)
+		frameBusTimeMax = frameBusTime;
+}
+
+//e.g. "i2c bus 400kHz worst case flush=2240us every 5ms frame max=812us (4%) over budget=0"
+void i2cBudgetPrint() {
+	unsigned long busTimeMax;
+	uint16_t overBudget;
+	I2C_ATOMIC {
+		busTimeMax = frameBusTimeMax;
+		overBudget = framesOverBudget;
+	}
+
+	serialTx.print(F("i2c bus "));
+	serialTx.print(I2C_CLOCK_HZ / 1000);
+	serialTx.print(F("kHz worst case flush="));
+	serialTx.print(I2C_FLUSH_WORST_CASE_US);
+	serialTx.print(F("us every "));
+	serialTx.print(I2C_FLUSH_INTERVAL_MS);
+	serialTx.print(F("ms frame max="));
+	serialTx.print(busTimeMax);
+	serialTx.print(F("us ("));
+	serialTx.print(busTimeMax / (SERVO_FRAME_MS * 10));
+	serialTx.print(F("%) over budget="));
+	serialTx.println(overBudget);
+}
+
+void i2cBudgetReset() {
+	I2C_ATOMIC {
+		frameBusTimeMax = 0;
+		framesOverBudget = 0;
+	}
+}
+
+#endif
@@ -0,0 +1,289 @@
+#include "I2CQueue.h"
+#include "SerialTx.h"
+
+static_assert(I2C_QUEUE_LENGTH > 0 && I2C_QUEUE_LENGTH < 128, "I2C_QUEUE_LENGTH out of range");
+
+struct sI2CTransaction {
+	uint8_t address;
+	uint8_t length;
+	uint8_t readLength;		// read after a repeated START, 0 for a write only
+	uint8_t tries;			// sent so far, not counting the first one
+	uint16_t tag;
+	I2CDoneCallback done;
+	void *context;
+	uint8_t *readData;
+	uint8_t data[I2C_QUEUE_DATA];
+};
+
+static sI2CTransaction queue[I2C_QUEUE_LENGTH];
+#ifdef __AVR__
+static_assert(sizeof(queue) == I2C_QUEUE_RAM, "I2C_QUEUE_RAM does not match sI2CTransaction");
+#endif
+static volatile uint8_t queueHead = 0;		// transaction on the bus
+static volatile uint8_t queueCount = 0;		// transactions waiting or on the bus
+static uint8_t queueTail = 0;				// next free slot, only i2cQueuePostRead() moves it: no need to read head and count together
+static unsigned long transactionStart;		// [µs] first START of the transaction on the bus
+
+volatile sI2CQueueStats i2cQueueStats;
+
+static inline void countUp(volatile uint16_t &counter) {
+	if (counter != 65535)
+		counter++;
+}
+
+//the transaction on the bus ended at /end/ [µs]. true if a transaction (this one again or the next) is to be started
+static bool transactionEnd(bool ack, unsigned long end) {
+	sI2CTransaction &transaction = queue[queueHead];
+
+	if (!ack) {
+		countUp(i2cQueueStats.nacks);
+		if (transaction.tries < I2C_QUEUE_RETRIES) {
+			transaction.tries++;
+			countUp(i2cQueueStats.retries);
+			return true;
+		}
+		countUp(i2cQueueStats.failed);
+	} else {
+		countUp(i2cQueueStats.transactions);
+	}
+
+	I2CDoneCallback done = transaction.done;
+	void *context = transaction.context;
+	uint16_t tag = transaction.tag;
+
+	queueHead = (queueHead + 1) % I2C_QUEUE_LENGTH;
+	queueCount--;
+
+	if (done)
+		done(context, tag, ack ? I2C_RESULT_OK : I2C_RESULT_FAILED, end - transactionStart);
+
+	return queueCount != 0;
+}
+
+#ifdef __AVR__
+#include <avr/interrupt.h>
+#include <util/twi.h>
+
+static uint8_t dataIndex;		// next byte of the transaction on the bus, written or read
+
+//TWINT cleared, interrupt on
+#define TWCR_NEXT (_BV(TWINT) | _BV(TWEN) | _BV(TWIE))
+
+//START for the transaction at the head of the queue, after a STOP if the bus was ours
+static void startTransaction(uint8_t control) {
+	if (queue[queueHead].tries == 0)
+		transactionStart = micros();
+	dataIndex = 0;
+	TWCR = control | TWCR_NEXT | _BV(TWSTA);
+}
+
+//TWINT cleared, ACK the byte to be received unless it is the last one
+static void receiveNext() {
+	if (dataIndex + 1 < queue[queueHead].readLength)
+		TWCR = TWCR_NEXT | _BV(TWEA);
+	else
+		TWCR = TWCR_NEXT;
+}
+
+static void transactionStop(bool ack) {
+	if (transactionEnd(ack, micros()))
+		startTransaction(_BV(TWSTO));
+	else
+		TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+}
+
+ISR(TWI_vect) {
+	sI2CTransaction &transaction = queue[queueHead];
+
+	switch (TW_STATUS) {
+		case TW_START:
+			//a read without anything to write starts reading right away
+			TWDR = (transaction.address << 1) | (transaction.length == 0 && transaction.readLength != 0 ? TW_READ : TW_WRITE);
+			TWCR = TWCR_NEXT;
+			break;
+
+		case TW_REP_START:
+			TWDR = (transaction.address << 1) | TW_READ;
+			TWCR = TWCR_NEXT;
+			break;
+
+		case TW_MT_SLA_ACK:
+		case TW_MT_DATA_ACK:
+			if (dataIndex < transaction.length) {
+				TWDR = transaction.data[dataIndex++];
+				TWCR = TWCR_NEXT;
+			} else if (transaction.readLength != 0) {
+				//all written, turn the bus around
+				dataIndex = 0;
+				TWCR = TWCR_NEXT | _BV(TWSTA);
+			} else {
+				transactionStop(true);
+			}
+			break;
+
+		case TW_MR_SLA_ACK:
+			receiveNext();
+			break;
+
+		case TW_MR_DATA_ACK:
+			transaction.readData[dataIndex++] = TWDR;
+			receiveNext();
+			break;
+
+		case TW_MR_DATA_NACK:
+			//the last byte, not acknowledged as the slave expects
+			transaction.readData[dataIndex] = TWDR;
+			transactionStop(true);
+			break;
+
+		case TW_MT_SLA_NACK:
+		case TW_MT_DATA_NACK:
+		case TW_MR_SLA_NACK:
+			transactionStop(false);
+			break;
+
+		case TW_MT_ARB_LOST:
+			//the bus is someone else's: no STOP, START again once it is free. same status as TW_MR_ARB_LOST
+			if (transactionEnd(false, micros()))
+				startTransaction(0);
+			else
+				TWCR = _BV(TWINT) | _BV(TWEN);
+			break;
+
+		default:
+			//bus error: release the bus with a STOP, try again
+			transactionStop(false);
+			break;
+	}
+}
+
+void i2cQueueBegin() {
+	I2C_ATOMIC {
+		//SCL = F_CPU / (16 + 2 * TWBR), prescaler 1. internal pull-ups on SDA and SCL, like Wire
+		TWSR = 0;
+		TWBR = (F_CPU / I2C_CLOCK_HZ - 16) / 2;
+		PORTD |= _BV(0) | _BV(1);
+		TWCR = _BV(TWEN);
+	}
+}
+
+//called with the transaction just queued, with interrupts off
+static void kick() {
+	if (queueCount == 1)
+		startTransaction(0);
+}
+
+#else
+#include "Sim.h"
+
+//no TWI on the host simulator: the bus is a stand-in in sim/ and transactions end as virtual time passes.
+//what the interrupt does on the AVR is done by service(), run by the simulator whenever its clock moved
+static unsigned long busFreeAt;		// [µs] end of the transaction on the bus
+
+static void startTransaction(unsigned long at) {
+	if (queue[queueHead].tries == 0)
+		transactionStart = at;
+	const sI2CTransaction &transaction = queue[queueHead];
+	//address byte, data, and for a read the address again after the repeated START
+	busFreeAt = at + sim::i2cBusTime(1 + transaction.length + (transaction.readLength ? 1 + transaction.readLength : 0), I2C_CLOCK_HZ);
+}
+
+static void service() {
+	while (queueCount != 0 && (long)(micros() - busFreeAt) >= 0) {
+		sI2CTransaction &transaction = queue[queueHead];
+		bool ack = sim::i2cTransfer(transaction.address, transaction.data, transaction.length, transaction.readData, transaction.readLength, I2C_CLOCK_HZ);
+
+		unsigned long end = busFreeAt;
+		if (transactionEnd(ack, end))
+			startTransaction(end);
+	}
+}
+
+void i2cQueueBegin() {
+	sim::setInterrupt(service);
+}
+
+static void kick() {
+	if (queueCount == 1)
+		startTransaction(micros());
+}
+
+#endif
+
+bool i2cQueuePost(uint8_t address, const uint8_t *data, uint8_t length, I2CDoneCallback done, void *context, uint16_t tag) {
+	return i2cQueuePostRead(address, data, length, NULL, 0, done, context, tag);
+}
+
+bool i2cQueuePostRead(uint8_t address, const uint8_t *data, uint8_t length, uint8_t *readData, uint8_t readLength, I2CDoneCallback done, void *context, uint16_t tag) {
+	if (length > I2C_QUEUE_DATA)
+		length = I2C_QUEUE_DATA;
+
+	//only the interrupt takes transactions off the queue: a free slot stays free
+	if (queueCount == I2C_QUEUE_LENGTH) {
+		I2C_ATOMIC {
+			countUp(i2cQueueStats.full);
+		}
+		return false;
+	}
+
+	sI2CTransaction &transaction = queue[queueTail];
+	transaction.address = address;
+	transaction.length = length;
+	transaction.readLength = readLength;
+	transaction.readData = readData;
+	transaction.tries = 0;
+	transaction.tag = tag;
+	transaction.done = done;
+	transaction.context = context;
+	if (length != 0)
+		memcpy(transaction.data, data, length);
+
+	queueTail = (queueTail + 1) % I2C_QUEUE_LENGTH;
+	I2C_ATOMIC {
+		queueCount++;
+		kick();
+	}
+	return true;
+}
+
+uint8_t i2cQueuePending() {
+	return queueCount;
+}
+
+void i2cQueueWait() {
+	while (i2cQueuePending() != 0)
+		delayMicroseconds(10);
+}
+
+//e.g. "i2c queue transactions=1520 nacks=0 retries=0 failed=0 full=3"
+void i2cQueuePrintStats() {
+	sI2CQueueStats stats;
+	I2C_ATOMIC {
+		stats.transactions = i2cQueueStats.transactions;
+		stats.nacks = i2cQueueStats.nacks;
+		stats.retries = i2cQueueStats.retries;
+		stats.failed = i2cQueueStats.failed;
+		stats.full = i2cQueueStats.full;
+	}
+
+	serialTx.print(F("i2c queue transactions="));
+	serialTx.print(stats.transactions);
+	serialTx.print(F(" nacks="));
+	serialTx.print(stats.nacks);
+	serialTx.print(F(" retries="));
+	serialTx.print(stats.retries);
+	serialTx.print(F(" failed="));
+	serialTx.print(stats.failed);
+	serialTx.print(F(" full="));
+	serialTx.println(stats.full);
+}
+
+void i2cQueueResetStats() {
+	I2C_ATOMIC {
+		i2cQueueStats.transactions = 0;
+		i2cQueueStats.nacks = 0;
+		i2cQueueStats.retries = 0;
+		i2cQueueStats.failed = 0;
+		i2cQueueStats.full = 0;
+	}
+}
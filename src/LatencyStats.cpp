@@ -0,0 +1,85 @@
+#include "LatencyStats.h"
+#include "SerialTx.h"
+
+#ifdef LATENCY_STATS
+
+sLatencyHistogram loopLatency;
+sLatencyHistogram commandLatency;
+sLatencyHistogram i2cLatency;
+sCommandLatency commandLatencies[LATENCY_STATS_COMMANDS];
+
+void latencyRecord(sLatencyHistogram *histogram, unsigned long us) {
+	//bucket = number of bits above the 16 µs of bucket 0
+	uint8_t bucket = 0;
+	for (unsigned long rest = us >> 4; rest != 0 && bucket < LATENCY_HISTOGRAM_BUCKETS - 1; rest >>= 1)
+		bucket++;
+
+	if (histogram->buckets[bucket] != 65535)
+		histogram->buckets[bucket]++;
+
+	if (us > histogram->max)
+		histogram->max = us;
+}
+
+void latencyRecordCommand(int16_t code, unsigned long us) {
+	latencyRecord(&commandLatency, us);
+
+	for (uint8_t i = 0; i < LATENCY_STATS_COMMANDS; i++) {
+		//first free entry is taken by a new code
+		if (commandLatencies[i].count == 0)
+			commandLatencies[i].code = code;
+		else if (commandLatencies[i].code != code)
+			continue;
+
+		if (commandLatencies[i].count != 65535)
+			commandLatencies[i].count++;
+		if (us > commandLatencies[i].max)
+			commandLatencies[i].max = us;
+		return;
+	}
+}
+
+//one line: name, longest, then "upper bound:count" of every bucket used
+void latencyPrint(const __FlashStringHelper *name, sLatencyHistogram *histogram) {
+	serialTx.print(name);
+	serialTx.print(F(" max="));
+	serialTx.print(histogram->max);
+	serialTx.print(F("us"));
+
+	for (uint8_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+		if (histogram->buckets[i] == 0)
+			continue;
+
+		serialTx.print(' ');
+		if (i == LATENCY_HISTOGRAM_BUCKETS - 1)
+			serialTx.print('>');
+		else
+			serialTx.print('<');
+		serialTx.print(16UL << (i == LATENCY_HISTOGRAM_BUCKETS - 1 ? i - 1 : i));
+		serialTx.print(':');
+		serialTx.print(histogram->buckets[i]);
+	}
+
+	serialTx.println();
+}
+
+//one line for the i-th M-code seen, false if there is none
+bool latencyPrintCommand(uint8_t i) {
+	if (i >= LATENCY_STATS_COMMANDS || commandLatencies[i].count == 0)
+		return false;
+
+	serialTx.print(F("M"));
+	serialTx.print(commandLatencies[i].code);
+	serialTx.print(F(" n="));
+	serialTx.print(commandLatencies[i].count);
+	serialTx.print(F(" max="));
+	serialTx.print(commandLatencies[i].max);
+	serialTx.println(F("us"));
+	return true;
+}
+
+void latencyResetCommands() {
+	memset(commandLatencies, 0, sizeof(commandLatencies));
+}
+
+#endif
@@ -0,0 +1,88 @@
+#include "MotionTimer.h"
+
+#ifdef MOTION_FRAME_TIMER
+
+volatile uint8_t motionFrameCount = 0;		// frames ticked by the timer
+volatile unsigned long motionFrameMillis = 0;	// millis() at the last tick
+uint8_t motionFramesDone = 0;
+unsigned long motionLastFrameTime = 0;
+
+#ifdef __AVR__
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+//Timer3 (16 bit) in CTC mode, prescaler 256: F_CPU/256 counts per s
+#define MOTION_TIMER_COMPARE ((F_CPU / 256UL) * SERVO_FRAME_MS / 1000UL - 1)
+
+ISR(TIMER3_COMPA_vect) {
+	motionFrameCount++;
+	motionFrameMillis = millis();
+}
+
+void motionTimerBegin() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		TCCR3A = 0;
+		TCCR3B = _BV(WGM32) | _BV(CS32);
+		TCNT3 = 0;
+		OCR3A = MOTION_TIMER_COMPARE;
+		TIMSK3 = _BV(OCIE3A);
+	}
+}
+
+bool motionFrameElapsed(unsigned long *frameTime) {
+	uint8_t frames;
+	unsigned long frameMillis;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		frames = motionFrameCount;
+		frameMillis = motionFrameMillis;
+	}
+
+	if (frames == motionFramesDone)
+		return false;
+
+	//frames missed while the loop was busy are caught up in one step
+	motionFramesDone = frames;
+	motionLastFrameTime = frameMillis;
+	*frameTime = frameMillis;
+	return true;
+}
+
+#else
+
+//no timer on the host simulator: frames are derived from the virtual clock
+void motionTimerBegin() {
+	motionLastFrameTime = millis();
+}
+
+bool motionFrameElapsed(unsigned long *frameTime) {
+	unsigned long now = millis();
+
+	if (now - motionLastFrameTime < SERVO_FRAME_MS)
+		return false;
+
+	motionLastFrameTime = now - (now - motionLastFrameTime) % SERVO_FRAME_MS;
+	*frameTime = motionLastFrameTime;
+	return true;
+}
+
+#endif
+
+unsigned long motionTime() {
+	return motionLastFrameTime;
+}
+
+#else
+
+void motionTimerBegin() {}
+
+bool motionFrameElapsed(unsigned long *frameTime) {
+	*frameTime = millis();
+	return true;
+}
+
+unsigned long motionTime() {
+	return millis();
+}
+
+#endif
@@ -0,0 +1,69 @@
+#include "SerialTx.h"
+
+#if SERIAL_TX_BUFFER_SIZE > 128 || (SERIAL_TX_BUFFER_SIZE & (SERIAL_TX_BUFFER_SIZE - 1)) != 0
+#error "SERIAL_TX_BUFFER_SIZE has to be a power of 2, 128 max"
+#endif
+
+SerialTxClass serialTx;
+
+size_t SerialTxClass::write(uint8_t c) {
+	//ring buffer full: make room the blocking way
+	if (this->count == SERIAL_TX_BUFFER_SIZE) {
+		#ifdef LATENCY_STATS
+		unsigned long stallStart = micros();
+		#endif
+
+		this->sendChunk(1);
+
+		#ifdef LATENCY_STATS
+		if (this->stalls != 65535)
+			this->stalls++;
+		this->stallTime += micros() - stallStart;
+		#endif
+	}
+
+	this->buffer[this->head] = c;
+	this->head = (this->head + 1) & (SERIAL_TX_BUFFER_SIZE - 1);
+	this->count++;
+	return 1;
+}
+
+int SerialTxClass::availableForWrite() {
+	return SERIAL_TX_BUFFER_SIZE - this->count;
+}
+
+bool SerialTxClass::isEmpty() {
+	return this->count == 0;
+}
+
+//hand up to /maxBytes/ of the oldest bytes to the port, at most up to the end of the ring
+void SerialTxClass::sendChunk(uint8_t maxBytes) {
+	uint8_t tail = (this->head - this->count) & (SERIAL_TX_BUFFER_SIZE - 1);
+	uint8_t length = SERIAL_TX_BUFFER_SIZE - tail;
+	if (length > this->count)
+		length = this->count;
+	if (length > maxBytes)
+		length = maxBytes;
+
+	Serial.write(&this->buffer[tail], length);
+	this->count -= length;
+}
+
+//send what the port takes right now, never waits
+void SerialTxClass::drain() {
+	//two chunks at most: up to the end of the ring, then from its start
+	for (uint8_t i = 0; i < 2 && this->count > 0; i++) {
+		int room = Serial.availableForWrite();
+		if (room <= 0)
+			return;
+
+		this->sendChunk(room > SERIAL_TX_BUFFER_SIZE ? SERIAL_TX_BUFFER_SIZE : room);
+	}
+}
+
+//send everything, waiting for the port if needed
+void SerialTxClass::flush() {
+	while (this->count > 0)
+		this->sendChunk(SERIAL_TX_BUFFER_SIZE);
+	Serial.flush();
+}
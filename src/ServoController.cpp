@@ -0,0 +1,179 @@
+#include "ServoController.h"
+#include "LatencyStats.h"
+#include "I2CBudget.h"
+
+//PCA9685 registers
+#define PCA9685_BASE_ADDRESS 0x40
+#define PCA9685_MODE1 0x00
+#define PCA9685_MODE2 0x01
+#define PCA9685_LED0 0x06			// LED0_ON_L, 4 registers per channel: ON_L, ON_H, OFF_L, OFF_H
+#define PCA9685_PRESCALE 0xFE
+#define PCA9685_SW_RESET 0x06		// general call command
+
+#define PCA9685_MODE1_AUTOINC 0x20
+#define PCA9685_MODE1_SLEEP 0x10
+#define PCA9685_MODE1_ALLCALL 0x01
+#define PCA9685_MODE2_TOTEMPOLE 0x04	// OCH = 0: outputs change on STOP, OUTNE = 00: low when disabled
+
+//25 MHz internal oscillator, 4096 counts per servo frame
+#define PCA9685_PRESCALE_SERVO ((25000000UL / 4096 * SERVO_FRAME_MS + 500) / 1000 - 1)
+#define PCA9685_PHASE_STEP (4096 / SERVO_CONTROLLER_CHANNELS)
+
+void ServoControllerClass::resetDevices() {
+	i2cQueueBegin();
+
+	uint8_t reset = PCA9685_SW_RESET;
+	i2cQueuePost(I2C_GENERAL_CALL_ADDRESS, &reset, 1);
+	i2cQueueWait();
+}
+
+//setup only: waits for the bus
+void ServoControllerClass::writeRegister(uint8_t reg, uint8_t value) {
+	uint8_t data[2] = { reg, value };
+	i2cQueuePost(this->address, data, sizeof(data));
+	i2cQueueWait();
+}
+
+void ServoControllerClass::begin(uint8_t address) {
+	this->address = PCA9685_BASE_ADDRESS | (address & 0x3F);
+
+	//the prescaler is only written while sleeping
+	this->writeRegister(PCA9685_MODE1, PCA9685_MODE1_AUTOINC | PCA9685_MODE1_SLEEP | PCA9685_MODE1_ALLCALL);
+	this->writeRegister(PCA9685_PRESCALE, PCA9685_PRESCALE_SERVO);
+	this->writeRegister(PCA9685_MODE1, PCA9685_MODE1_AUTOINC | PCA9685_MODE1_ALLCALL);
+	//outputs change on STOP: a burst written by flush() takes effect at once, no half updated channels
+	this->writeRegister(PCA9685_MODE2, PCA9685_MODE2_TOTEMPOLE);
+	//oscillator start up
+	delayMicroseconds(500);
+
+	//the reset turned all channels off
+	for (uint8_t i = 0; i < SERVO_CONTROLLER_CHANNELS; i++)
+		this->channelPWM[i] = 0;
+	this->dirtyChannels = 0;
+	this->failedChannels = 0;
+	this->failedBursts = 0;
+	this->offline = false;
+	this->offlineReported = false;
+}
+
+void ServoControllerClass::setChannelPWM(uint8_t channel, uint16_t pwm) {
+	//like on the device itself, there is no output behind channels out of range
+	if (channel >= SERVO_CONTROLLER_CHANNELS)
+		return;
+
+	if (this->channelPWM[channel] == pwm)
+		return;
+
+	this->channelPWM[channel] = pwm;
+	this->dirtyChannels |= (uint16_t)1 << channel;
+}
+
+//full on/off are just special pwm values for the device (on bit / off bit set)
+void ServoControllerClass::setChannelOn(uint8_t channel) {
+	this->setChannelPWM(channel, SERVO_CONTROLLER_PWM_FULL);
+}
+
+void ServoControllerClass::setChannelOff(uint8_t channel) {
+	this->setChannelPWM(channel, 0);
+}
+
+bool ServoControllerClass::isDirty() {
+	return !this->offline && (this->dirtyChannels != 0 || this->failedChannels != 0);
+}
+
+bool ServoControllerClass::takeOfflineReport() {
+	if (!this->offline || this->offlineReported)
+		return false;
+	this->offlineReported = true;
+	return true;
+}
+
+//called from the interrupt. /tag/: first channel of the burst, channel count in the high byte
+void ServoControllerClass::burstDone(void *context, uint16_t tag, eI2CResult result, unsigned long us) {
+	ServoControllerClass *controller = (ServoControllerClass *)context;
+
+	if (result != I2C_RESULT_OK) {
+		controller->failedChannels |= (uint16_t)(((1U << (tag >> 8)) - 1) << (tag & 0xFF));
+		if (++controller->failedBursts >= I2C_CONTROLLER_FAILED_BURSTS)
+			controller->offline = true;
+		return;
+	}
+	controller->failedBursts = 0;
+
+	#ifdef LATENCY_STATS
+	latencyRecord(&i2cLatency, us);
+	i2cBudgetRecord(us);
+	if (controller->bursts != 65535)
+		controller->bursts++;
+	if (us > controller->burstMax)
+		controller->burstMax = us;
+	#else
+	(void)us;
+	#endif
+}
+
+//posts at most /bursts/ bursts, returns how many
+uint8_t ServoControllerClass::flush(uint8_t bursts) {
+	//bursts that failed are sent again, unless the device does not answer at all
+	uint16_t failed;
+	I2C_ATOMIC {
+		failed = this->failedChannels;
+		this->failedChannels = 0;
+	}
+	if (this->offline) {
+		this->dirtyChannels = 0;
+		return 0;
+	}
+	this->dirtyChannels |= failed;
+
+	uint16_t dirty = this->dirtyChannels;
+	uint8_t channel = 0;
+	uint8_t posted = 0;
+
+	while (dirty != 0 && posted < bursts) {
+		//skip unchanged channels
+		while (!(dirty & 1)) {
+			dirty >>= 1;
+			channel++;
+		}
+
+		//find the end of this run of changed channels, as much as fits one transaction
+		uint8_t firstChannel = channel;
+		while ((dirty & 1) && channel - firstChannel < SERVO_CONTROLLER_BURST_CHANNELS) {
+			dirty >>= 1;
+			channel++;
+		}
+		uint8_t count = channel - firstChannel;
+
+		//ON and OFF count of each channel, the way the PCA9685 takes full on and full off (datasheet 7.3.3)
+		uint8_t data[1 + 4 * SERVO_CONTROLLER_BURST_CHANNELS];
+		data[0] = PCA9685_LED0 + 4 * firstChannel;
+		for (uint8_t i = 0; i < count; i++) {
+			uint16_t pwm = this->channelPWM[firstChannel + i];
+			uint16_t on = (firstChannel + i) * PCA9685_PHASE_STEP;
+			uint16_t off;
+
+			if (pwm == 0) {
+				off = SERVO_CONTROLLER_PWM_FULL;
+			} else if (pwm >= SERVO_CONTROLLER_PWM_FULL) {
+				on |= SERVO_CONTROLLER_PWM_FULL;
+				off = 0;
+			} else {
+				off = (on + pwm) & (SERVO_CONTROLLER_PWM_FULL - 1);
+			}
+
+			data[1 + 4 * i] = on & 0xFF;
+			data[2 + 4 * i] = on >> 8;
+			data[3 + 4 * i] = off & 0xFF;
+			data[4 + 4 * i] = off >> 8;
+		}
+
+		//queue full: the rest stays dirty for the next flush
+		if (!i2cQueuePost(this->address, data, 1 + 4 * count, burstDone, this, firstChannel | (uint16_t)count << 8))
+			break;
+
+		this->dirtyChannels &= ~(uint16_t)((((uint16_t)1 << count) - 1) << firstChannel);
+		posted++;
+	}
+	return posted;
+}
@@ -0,0 +1,246 @@
+#include "gcode.h"
+
+char inputBuffer[MAX_BUFFFER_MCODE_LINE];
+uint8_t inputBufferLength = 0;
+bool inputBufferOverflow = false;
+
+// letter/value pairs of the current line, filled once per line by parseGCodeLine()
+struct sGCodeParameter {
+	char code;
+	uint8_t offset;		// of the value in inputBuffer, for lists
+	int32_t value;		// fixed point, 1/GCODE_FIXED_POINT_SCALE
+};
+
+static sGCodeParameter gcodeParameters[MAX_GCODE_PARAMETERS];
+#ifdef __AVR__
+static_assert(sizeof(gcodeParameters) == GCODE_PARAMETERS_RAM, "GCODE_PARAMETERS_RAM does not match sGCodeParameter");
+#endif
+static uint8_t gcodeParameterCount = 0;
+
+
+/**
+* Split the inputBuffer into letter/value pairs in a single pass. Words are separated by
+* whitespace, a ";" starts a comment. Values are converted to fixed point with
+* GCODE_FIXED_POINT_DECIMALS decimals, further decimals are truncated.
+* Only a letter at the start of a word (or right after a number) is a parameter,
+* so letters inside other values or in comments are never matched.
+**/
+void parseGCodeLine()
+{
+	gcodeParameterCount = 0;
+
+	uint8_t i = 0;
+	while (i < inputBufferLength)
+	{
+		char c = inputBuffer[i];
+
+		if (c == ';')
+			break;
+
+		if (c == ' ' || c == '\t' || c == '\r')
+		{
+			i++;
+			continue;
+		}
+
+		if (c >= 'a' && c <= 'z')
+			c -= 'a' - 'A';
+
+		if (c >= 'A' && c <= 'Z' && gcodeParameterCount < MAX_GCODE_PARAMETERS)
+		{
+			i++;
+			gcodeParameters[gcodeParameterCount].offset = i;
+
+			bool negative = false;
+			if (i < inputBufferLength && (inputBuffer[i] == '-' || inputBuffer[i] == '+'))
+			{
+				negative = (inputBuffer[i] == '-');
+				i++;
+			}
+
+			int32_t integerPart = 0;
+			while (i < inputBufferLength && inputBuffer[i] >= '0' && inputBuffer[i] <= '9')
+			{
+				//saturate instead of overflowing on absurd input
+				if (integerPart < GCODE_MAX_INTEGER_PART)
+					integerPart = integerPart * 10 + (inputBuffer[i] - '0');
+				i++;
+			}
+
+			int32_t fraction = 0;
+			int32_t fractionScale = GCODE_FIXED_POINT_SCALE;
+			if (i < inputBufferLength && inputBuffer[i] == '.')
+			{
+				i++;
+				while (i < inputBufferLength && inputBuffer[i] >= '0' && inputBuffer[i] <= '9')
+				{
+					if (fractionScale > 1)
+					{
+						fractionScale /= 10;
+						fraction += (inputBuffer[i] - '0') * fractionScale;
+					}
+					i++;
+				}
+			}
+
+			int32_t value = integerPart * GCODE_FIXED_POINT_SCALE + fraction;
+
+			gcodeParameters[gcodeParameterCount].code = c;
+			gcodeParameters[gcodeParameterCount].value = negative ? -value : value;
+			gcodeParameterCount++;
+
+			//a letter right after the number starts the next word (compact form "M600N3")
+			if (i < inputBufferLength && isAlpha(inputBuffer[i]))
+				continue;
+		}
+
+		//skip the rest of the word
+		while (i < inputBufferLength && inputBuffer[i] != ' ' && inputBuffer[i] != '\t' && inputBuffer[i] != ';')
+			i++;
+	}
+}
+
+/**
+* Look up the fixed point value given for letter /code/ on the current line.
+* @return true if the letter was given, the value is stored to /value/.
+**/
+bool findParameter(char code, int32_t *value)
+{
+	for (uint8_t i = 0; i < gcodeParameterCount; i++)
+	{
+		if (gcodeParameters[i].code == code)
+		{
+			*value = gcodeParameters[i].value;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+* Start reading the comma separated list of non negative integers given for /code/, e.g. "N1,4,6:9".
+* Ascending ranges "first:last" are expanded. Values are fetched with nextParameterListValue().
+* @return false if /code/ is not given.
+**/
+bool beginParameterList(char code, sGCodeList *list)
+{
+	for (uint8_t i = 0; i < gcodeParameterCount; i++)
+	{
+		if (gcodeParameters[i].code == code)
+		{
+			list->position = gcodeParameters[i].offset;
+			list->next = 1;
+			list->last = 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool readListNumber(sGCodeList *list, int16_t *value)
+{
+	uint8_t start = list->position;
+	int16_t number = 0;
+
+	while (list->position < inputBufferLength && isDigit(inputBuffer[list->position]))
+	{
+		if (number < 1000)
+			number = number * 10 + (inputBuffer[list->position] - '0');
+		list->position++;
+	}
+
+	*value = number;
+	return list->position != start;
+}
+
+/**
+* Fetch the next value of a list started by beginParameterList().
+* @return false at the end of the list or on anything that is not a number.
+**/
+bool nextParameterListValue(sGCodeList *list, int16_t *value)
+{
+	//range in progress
+	if (list->next <= list->last)
+	{
+		*value = list->next++;
+		return true;
+	}
+
+	int16_t first;
+	if (!readListNumber(list, &first))
+		return false;
+
+	if (list->position < inputBufferLength && inputBuffer[list->position] == ':')
+	{
+		list->position++;
+		if (!readListNumber(list, &list->last))
+			return false;
+		list->next = first + 1;
+	}
+
+	if (list->position < inputBufferLength && inputBuffer[list->position] == ',')
+		list->position++;
+	else
+		list->position = inputBufferLength;	//end of list
+
+	*value = first;
+	return true;
+}
+
+/**
+* Look for character /code/ on the current line and return the integer part of the number that immediately follows it.
+* @return the value found.  If nothing is found, /defaultVal/ is returned.
+* @input code the character to look for.
+* @input defaultVal the return value if /code/ is not found.
+**/
+int32_t parseParameter(char code, int32_t defaultVal)
+{
+	int32_t value;
+
+	if (findParameter(code, &value))
+		return value / GCODE_FIXED_POINT_SCALE;
+
+	return defaultVal;
+}
+
+/**
+* Read a non negative rate for /code/ and store it with /resolution/ steps per unit, e.g. 256 for 1/256 °/ms.
+* @return the rounded value, at least 1 if not 0, saturated at 65535. /oldValue/ if not given or negative.
+**/
+uint16_t parseRateParameter(char code, uint16_t oldValue, uint32_t resolution)
+{
+	int32_t newValue;
+
+	if (!findParameter(code, &newValue) || newValue < 0)
+		return oldValue;
+	if (newValue == 0)
+		return 0;
+	if ((uint32_t)newValue >= (65536UL * GCODE_FIXED_POINT_SCALE) / resolution)
+		return 65535;
+
+	uint16_t newParam = ((uint32_t)newValue * resolution + GCODE_FIXED_POINT_SCALE / 2) / GCODE_FIXED_POINT_SCALE;
+
+	if (newParam < 1)
+		return 1;
+
+	return newParam;
+}
+
+//degree per ms to 1/256 degree per ms
+uint16_t parseSpeedParameter(char code,uint16_t oldValue)
+{
+	return parseRateParameter(code, oldValue, 256);
+}
+
+//degree per ms² to 1/4096 degree per ms²
+uint16_t parseAccelerationParameter(char code,uint16_t oldValue)
+{
+	return parseRateParameter(code, oldValue, 4096);
+}
+
+void setupGCodeProc()
+{
+	inputBufferLength = 0;
+	inputBufferOverflow = false;
+	gcodeParameterCount = 0;
+}
@@ -31,11 +31,22 @@
 #include <HardwareSerial.h>
 #include <EEPROMex.h>
 #include "Feeder.h"
+#include "MotionTimer.h"
+#include "SerialTx.h"
+#include "LatencyStats.h"
+#include "I2CBudget.h"
+#include "I2CQueue.h"
+#include "FeedbackLines.h"
+#include "gcode.h"
 
 // ------------------  V A R  S E T U P -----------------------
 
 // ------ Feeders
 FeederClass feeders[NUMBER_OF_FEEDER];
+#ifdef RAMEND
+static_assert(sizeof(feeders) + sizeof(FeederClass::motion) <= FEEDER_BANK_RAM_BUDGET, "feeders do not fit FEEDER_BANK_RAM_BUDGET");
+static_assert(FEEDER_BANK_RAM_BUDGET < RAMEND - RAMSTART + 1, "FEEDER_BANK_RAM_BUDGET is more than the RAM");
+#endif
 
 enum eFeederEnabledState
 {
@@ -43,6 +54,61 @@ enum eFeederEnabledState
   ENABLED,
 } feederEnabled;
 
+// ------ Batch advance (M605): feeders started together, answered once all of them settled
+#define ADVANCE_BATCH_NOT_LISTED 0xFF
+
+struct sAdvanceBatch {
+	bool active;
+	uint8_t pending[(NUMBER_OF_FEEDER + 7) / 8];	// advancing, bit per feeder
+	uint8_t notOk[(NUMBER_OF_FEEDER + 7) / 8];		// not started, feeder in error state
+	uint8_t busy[(NUMBER_OF_FEEDER + 7) / 8];		// not started, advance queue full
+	uint8_t aborted[(NUMBER_OF_FEEDER + 7) / 8];	// started, dropped by M610 before it settled
+} advanceBatch;
+
+
+
+// ------ M630/M633 for all feeders: next feeder to print, NUMBER_OF_FEEDER if no dump running
+#define FEEDER_DUMP_LINE_LENGTH 112		// longest line of outputCurrentSettings() / outputStats()
+
+enum eFeederDump
+{
+	DUMP_SETTINGS,
+	DUMP_STATS,
+	DUMP_STATS_RESET,
+	DUMP_LATENCY,		// M632, one section per loop iteration. feederDumpNext only tells it runs, see continueLatencyReport()
+} feederDumpKind;
+
+uint16_t feederDumpNext = NUMBER_OF_FEEDER;
+bool readyPending = false;		// "up and ready" still to be sent after the settings dump of setup(), hosts start sending on it
+
+#ifdef LATENCY_STATS
+// ------ M632: section of the report printed next
+enum eLatencyReport
+{
+	REPORT_LOOP,
+	REPORT_COMMAND,
+	REPORT_COMMANDS,		// one line per M-code seen
+	REPORT_I2C,
+	REPORT_CONTROLLERS,		// one line per controller
+	REPORT_BUDGET,
+	REPORT_QUEUE,
+	REPORT_SERIAL,
+	REPORT_ANSWER,
+};
+
+uint8_t latencyReportSection;
+uint8_t latencyReportItem;		// line within the section
+#endif
+
+
+
+// ------ Settings journal: feeder whose settings are being written behind, with the offset to go on from
+#define SETTINGS_JOURNAL_IDLE 0xFFFF
+
+uint16_t settingsJournalFeederNo = SETTINGS_JOURNAL_IDLE;
+uint8_t settingsJournalOffset = 0;
+uint16_t positionJournalFeederNo = 0;		// next feeder whose lever position is checked for saving
+
 
 
 // ------ Settings-Struct (saved in EEPROM)
@@ -65,7 +131,36 @@ sCommonSettings commonSettings;
 
 
 // ------ I²C controllers
-PCA9685 servoControllers[NUMBER_OF_CONTROLLERS];
+ServoControllerClass servoControllers[NUMBER_OF_CONTROLLERS];
+
+//A5..A0 = 110000 is the LED All Call address (0x70) every PCA9685 answers to after reset
+#define CONTROLLER_ADDRESS_ALL_CALL 0x30
+//bus addresses 0x78..0x7F (A5..A0 = 111xxx) are reserved by I²C: 10 bit addressing and future use
+#define CONTROLLER_ADDRESS_LAST 0x37
+
+#ifdef CONTROLLER_ADDRESSES
+constexpr uint8_t controllerAddresses[] PROGMEM = CONTROLLER_ADDRESSES;
+static_assert(sizeof(controllerAddresses) == NUMBER_OF_CONTROLLERS, "CONTROLLER_ADDRESSES needs one entry per controller");
+
+//every address up to CONTROLLER_ADDRESS_LAST, none the All Call one, no two the same
+constexpr bool controllerAddressesValid(uint8_t i, uint8_t j) {
+	return i >= NUMBER_OF_CONTROLLERS ? true
+		: j >= NUMBER_OF_CONTROLLERS ? controllerAddressesValid(i + 1, i + 2)
+		: controllerAddresses[i] != controllerAddresses[j] && controllerAddressesValid(i, j + 1);
+}
+constexpr bool controllerAddressesInRange(uint8_t i) {
+	return i >= NUMBER_OF_CONTROLLERS ? true
+		: controllerAddresses[i] <= CONTROLLER_ADDRESS_LAST && controllerAddresses[i] != CONTROLLER_ADDRESS_ALL_CALL && controllerAddressesInRange(i + 1);
+}
+static_assert(controllerAddressesInRange(0), "CONTROLLER_ADDRESSES: 0x00..0x37 (0x38..0x3F are reserved bus addresses), but not 0x30 (All Call)");
+static_assert(controllerAddressesValid(0, 1), "CONTROLLER_ADDRESSES: an address is used twice");
+
+#define controllerAddress(i) pgm_read_byte(&controllerAddresses[i])
+#else
+//0, 1, 2, ... skipping the All Call address
+#define controllerAddress(i) ((i) < CONTROLLER_ADDRESS_ALL_CALL ? (i) : (i) + 1)
+static_assert(controllerAddress(NUMBER_OF_CONTROLLERS - 1) <= CONTROLLER_ADDRESS_LAST, "controllers would reach the reserved bus addresses 0x78..0x7F");
+#endif
 
 
 
@@ -75,7 +170,6 @@ PCA9685 servoControllers[NUMBER_OF_CONTROLLERS];
 enum eFeederCommands
 {
 	cmdSetup,
-	cmdUpdate,
 
 	cmdEnable,
 	cmdDisable,
@@ -95,9 +189,6 @@ void executeCommandOnAllFeeder(eFeederCommands command)
 			case cmdSetup:
 				feeders[i].setup(servoControllers);
 			break;
-			case cmdUpdate:
-				feeders[i].update();
-			break;
 			case cmdEnable:
 				feeders[i].enable();
 			break;
@@ -120,72 +211,177 @@ void executeCommandOnAllFeeder(eFeederCommands command)
 	}
 }
 
-void printCommonSettings() {}
+// ------ Call update() of active feeders only, idle ones cost nothing. /now/ is one timestamp for all of them
+void updateActiveFeeders(unsigned long now)
+{
+	for (uint8_t i = 0; i < sizeof(FeederClass::activeFeeders); i++)
+	{
+		uint8_t active = FeederClass::activeFeeders[i];
 
+		//eight idle feeders skipped at once
+		if (active == 0)
+			continue;
 
-// ----- GCode functions -----
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			if ((active & ((uint8_t)1 << bit)) && !feeders[(i << 3) + bit].update(now))
+			{
+				FeederClass::activeFeeders[i] &= ~((uint8_t)1 << bit);
+			}
+		}
+	}
+}
 
-String inputBuffer = "";         // Buffer for incoming G-Code lines
+void printCommonSettings() {}
 
+bool anyFeederActive()
+{
+	for (uint8_t i = 0; i < sizeof(FeederClass::activeFeeders); i++)
+	{
+		if (FeederClass::activeFeeders[i] != 0)
+			return true;
+	}
+	return false;
+}
 
-/**
-* Look for character /code/ in the inputBuffer and read the float that immediately follows it.
-* @return the value found.  If nothing is found, /defaultVal/ is returned.
-* @input code the character to look for.
-* @input defaultVal the return value if /code/ is not found.
-**/
-float parseParameter(char code,float defaultVal)
+// ------ Queue the channels changed since last call to the controllers, the TWI interrupt sends them
+//at most I2C_FLUSH_BURSTS_MAX bursts, the bus budget is reckoned with that. the controller served first
+//takes turns, so the others are not left waiting behind one with many changes.
+//returns true if anything was to be written
+bool flushServoControllers()
 {
-	int codePosition = inputBuffer.indexOf(code);
+	static uint8_t firstController = 0;
+	bool written = false;
+	uint8_t bursts = I2C_FLUSH_BURSTS_MAX;
+	for (uint8_t n = 0; n < NUMBER_OF_CONTROLLERS && bursts != 0; n++)
+	{
+		uint8_t i = (firstController + n) % NUMBER_OF_CONTROLLERS;
+		if (servoControllers[i].isDirty())
+		{
+			bursts -= servoControllers[i].flush(bursts);
+			written = true;
+		}
+	}
+	firstController = (firstController + 1) % NUMBER_OF_CONTROLLERS;
+	return written;
+}
 
-	if(codePosition != -1) {
-		//code found in buffer
+// ------ Process servo control of moving feeders, every loop or once per servo frame (MOTION_FRAME_TIMER), by loop() and the homing in setup()
+void runMotionFrame()
+{
+	unsigned long motionNow;
+	if (!motionFrameElapsed(&motionNow))
+		return;
 
-		//find end of number (separated by " " (space))
-		int delimiterPosition = inputBuffer.indexOf(" ", codePosition+1);
+	updateActiveFeeders(motionNow);
 
-		float parsedNumber = inputBuffer.substring(codePosition + 1, delimiterPosition).toFloat();
+	// Queue the servo changes, one I²C burst per run of changed channels, spaced to keep within the bus budget (I2CBudget.h)
+	if (i2cFlushDue(motionNow) && flushServoControllers())
+		i2cFlushDone(motionNow);
+}
 
-		return parsedNumber;
-	}
-	else
+// ------ A controller whose bursts kept failing is offline (ServoController.h): say so once, not as an answer to a command
+void reportOfflineControllers()
+{
+	for (uint8_t i = 0; i < NUMBER_OF_CONTROLLERS; i++)
 	{
-		return defaultVal;
+		if (servoControllers[i].takeOfflineReport())
+		{
+			serialTx.print(F("warning PCA9685 n° "));
+			serialTx.print(i);
+			serialTx.print(F(" at 0x"));
+			serialTx.print(servoControllers[i].getAddress(), HEX);
+			serialTx.println(F(" not answering, its feeders are not driven until reset"));
+		}
 	}
 }
 
-uint16_t parseSpeedParameter(char code,uint16_t oldValue)
+/**
+* Write changed feeder settings to EEPROM behind: at most one byte per call and only if the EEPROM
+* is done with the last one, so the loop never waits for a cell to be programmed (about 3.3 ms each).
+* With all settings saved, the last lever positions are saved the same way.
+*/
+void persistSettingsStep()
 {
-	float newValue = parseParameter(code, -1);
+	if(!EEPROM.isReady())
+		return;
 
-	if (newValue < 0)
-		return oldValue;
-	if (newValue == 0)
-		return 0;
-	if (newValue >= 256)
-		return 65535;
+	if(settingsJournalFeederNo == SETTINGS_JOURNAL_IDLE)
+	{
+		//pick the next feeder with unsaved settings
+		for (uint8_t i = 0; i < sizeof(FeederClass::unsavedSettings); i++)
+		{
+			uint8_t unsaved = FeederClass::unsavedSettings[i];
+			if (unsaved == 0)
+				continue;
+
+			uint8_t bit = 0;
+			while (!(unsaved & ((uint8_t)1 << bit)))
+				bit++;
+
+			//settings changed while being written mark the feeder again, it is then compared once more
+			FeederClass::unsavedSettings[i] &= ~((uint8_t)1 << bit);
+			settingsJournalFeederNo = (i << 3) + bit;
+			settingsJournalOffset = 0;
+			break;
+		}
 
-	uint16_t newParam = round(newValue * 256);
+		if(settingsJournalFeederNo == SETTINGS_JOURNAL_IDLE)
+		{
+			//no settings to write: check the lever position of one feeder, round robin
+			feeders[positionJournalFeederNo].persistPosition(millis());
+			positionJournalFeederNo = (positionJournalFeederNo + 1) % NUMBER_OF_FEEDER;
+			return;
+		}
+	}
 
-	if (newParam < 1)
-		return 1;
+	settingsJournalOffset = feeders[settingsJournalFeederNo].persistSettingsFrom(settingsJournalOffset, SETTINGS_JOURNAL_COMPARES_PER_STEP);
 
-	return newParam;
+	if(settingsJournalOffset >= FEEDER_SETTINGS_RECORD_SIZE)
+		settingsJournalFeederNo = SETTINGS_JOURNAL_IDLE;
 }
 
-void setupGCodeProc()
+//write all unsaved feeder settings now (M623). returns the number of bytes written
+uint16_t commitFeederSettings()
 {
-	inputBuffer.reserve(MAX_BUFFFER_MCODE_LINE);
+	uint16_t bytesWritten = 0;
+
+	if(settingsJournalFeederNo != SETTINGS_JOURNAL_IDLE)
+	{
+		bytesWritten += feeders[settingsJournalFeederNo].commitSettings();
+		settingsJournalFeederNo = SETTINGS_JOURNAL_IDLE;
+	}
+
+	for (uint16_t i = 0; i < NUMBER_OF_FEEDER; i++)
+	{
+		if (FeederClass::unsavedSettings[i >> 3] & ((uint8_t)1 << (i & 7)))
+			bytesWritten += feeders[i].commitSettings();
+	}
+
+	return bytesWritten;
 }
 
-void sendAnswer(uint8_t error, String message)
+
+// answers of several commands, stored once in flash
+const char answerFeederNoMissing[] PROGMEM = "feederNo missing or invalid";
+const char answerFeederNoInvalid[] PROGMEM = "feederNo invalid";
+const char answerInvalidFeedLength[] PROGMEM = "Invalid feedLength";
+const char answerConfigUpdated[] PROGMEM = "Feeders config updated.";
+
+#define FLASH_ANSWER(answer) (reinterpret_cast<const __FlashStringHelper *>(answer))
+
+void sendAnswerPrefix(uint8_t error)
 {
 	if(error==0)
-		Serial.print(F("ok "));
+		serialTx.print(F("ok "));
 	else
-		Serial.print(F("error "));
+		serialTx.print(F("error "));
+}
 
-	Serial.println(message);
+void sendAnswer(uint8_t error, const __FlashStringHelper *message)
+{
+	sendAnswerPrefix(error);
+	serialTx.println(message);
 }
 
 bool validFeederNo(int16_t signedFeederNo)
@@ -203,15 +399,132 @@ bool validFeederNoError(int16_t signedFeederNo)
 {
 	bool ret = !validFeederNo(signedFeederNo);
 	if (ret)
-		sendAnswer(1, F("feederNo missing or invalid"));
+		sendAnswer(1, FLASH_ANSWER(answerFeederNoMissing));
 	return ret;
 }
 
+void printAdvanceBatchFailures(const uint8_t *bitmap, const __FlashStringHelper *reason)
+{
+	for (uint16_t i = 0; i < NUMBER_OF_FEEDER; i++)
+	{
+		if (isFeederBitSet(bitmap, i))
+		{
+			serialTx.print(F(" N"));
+			serialTx.print(i);
+			serialTx.print(reason);
+		}
+	}
+}
+
+/**
+* Answer a running batch advance once none of its feeders is advancing anymore.
+* Feeders that could not be started, or whose advance M610 dropped before it settled, are listed in an error answer.
+*/
+void checkAdvanceBatch()
+{
+	if (!advanceBatch.active)
+		return;
+
+	bool stillAdvancing = false;
+	for (uint8_t i = 0; i < sizeof(advanceBatch.pending); i++)
+	{
+		if (advanceBatch.pending[i] == 0)
+			continue;
+
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			if (advanceBatch.pending[i] & ((uint8_t)1 << bit))
+			{
+				FeederClass &feeder = feeders[(i << 3) + bit];
+				if (feeder.batchAdvancePending())
+				{
+					stillAdvancing = true;
+				}
+				else
+				{
+					advanceBatch.pending[i] &= ~((uint8_t)1 << bit);
+					if (feeder.batchAdvanceAborted())
+						advanceBatch.aborted[i] |= (uint8_t)1 << bit;
+				}
+			}
+		}
+	}
+
+	if (stillAdvancing)
+		return;
+
+	advanceBatch.active = false;
+
+	bool failed = false;
+	for (uint8_t i = 0; i < sizeof(advanceBatch.pending); i++)
+	{
+		if (advanceBatch.notOk[i] | advanceBatch.busy[i] | advanceBatch.aborted[i])
+			failed = true;
+	}
+
+	if (!failed)
+	{
+		serialTx.println(F("ok, batch advancing cycle completed"));
+		return;
+	}
+
+	serialTx.print(F("error batch advance failed:"));
+	printAdvanceBatchFailures(advanceBatch.notOk, F(" not OK"));
+	printAdvanceBatchFailures(advanceBatch.busy, F(" busy"));
+	printAdvanceBatchFailures(advanceBatch.aborted, F(" aborted"));
+	serialTx.println();
+}
+
+//feeders were disabled, the batch will never complete
+void abortAdvanceBatch()
+{
+	if (!advanceBatch.active)
+		return;
+
+	advanceBatch.active = false;
+	sendAnswer(1, F("batch advance aborted, feeders disabled"));
+}
+
+#ifdef HAS_FEEDBACKLINES
+//tensioner pressed short and released: advance by the feeder's default feed length, errors overridden.
+//only idle feeders, a press while moving is dropped
+void checkManualFeeds()
+{
+	for (uint8_t i = 0; i < sizeof(feedbackManualFeeds); i++)
+	{
+		if (feedbackManualFeeds[i] == 0)
+			continue;
+
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			if (!(feedbackManualFeeds[i] & ((uint8_t)1 << bit)))
+				continue;
+
+			FeederClass &feeder = feeders[(i << 3) + bit];
+			if (feeder.feederState() == FeederClass::sIDLE)
+			{
+				#ifdef DEBUG
+					serialTx.print(F("Manual feed triggered for feeder N"));
+					serialTx.println((i << 3) + bit);
+				#endif
+				//moved on by hand past a pre-fed part: the next advance feeds again
+				feeder.clearPrefeed();
+				feeder.advance(feeder.getSettings().feed_length, true);
+			}
+		}
+		feedbackManualFeeds[i] = 0;
+	}
+}
+#endif
+
 bool checkEnabledFeedersError()
 {
 	if(feederEnabled!=ENABLED)
 	{
-		sendAnswer(1, String(String("Enable feeder first! M") + String(MCODE_SET_FEEDER_ENABLE) + String(" S1")));
+		sendAnswerPrefix(1);
+		serialTx.print(F("Enable feeder first! M"));
+		serialTx.print(MCODE_SET_FEEDER_ENABLE);
+		serialTx.println(F(" S1"));
 		return true;
 	}
 	return false;
@@ -222,12 +535,14 @@ bool checkEnabledFeedersError()
 */
 void processCommand()
 {
+	parseGCodeLine();
+
 	//get the command, default -1 if no command found
 	int cmd = parseParameter('M', -1);
 
 	#ifdef DEBUG
-	Serial.print("command found: M");
-	Serial.println(cmd);
+	serialTx.print(F("command found: M"));
+	serialTx.println(cmd);
 	#endif
 
 	switch(cmd)
@@ -272,6 +587,7 @@ void processCommand()
 					feederEnabled = DISABLED;
 
 					executeCommandOnAllFeeder(cmdDisable);
+					abortAdvanceBatch();
 
 					sendAnswer(0, F("Feeder set disabled"));
 				}
@@ -279,7 +595,9 @@ void processCommand()
 			}
 			else if(_feederEnabled == -1)
 			{
-				sendAnswer(0, ("current powerState: ") + String(feederEnabled));
+				sendAnswerPrefix(0);
+				serialTx.print(F("current powerState: "));
+				serialTx.println(feederEnabled);
 			}
 			else
 			{
@@ -303,7 +621,7 @@ void processCommand()
 			{
 				overrideError = true;
 				#ifdef DEBUG
-				Serial.println("Argument X1 found, feedbackline/error will be ignored");
+				serialTx.println(F("Argument X1 found, feedbackline/error will be ignored"));
 				#endif
 			}
 
@@ -319,16 +637,24 @@ void processCommand()
 			if ( ((feedLength%2) != 0) || feedLength > 24 )
 			{
 				//advancing is only possible for multiples of 2mm and 24mm max
-				sendAnswer(1, F("Invalid feedLength"));
+				sendAnswer(1, FLASH_ANSWER(answerInvalidFeedLength));
 				break;
 			}
 
 			#ifdef DEBUG
-			Serial.print("Determined feedLength ");
-			Serial.print(feedLength);
-			Serial.println();
+			serialTx.print(F("Determined feedLength "));
+			serialTx.print(feedLength);
+			serialTx.println();
 			#endif
 
+			//a busy feeder queues the advance, but only up to FEEDER_ADVANCE_QUEUE_LENGTH
+			if(feeders[(uint16_t)signedFeederNo].advanceQueueIsFull())
+			{
+				feeders[(uint16_t)signedFeederNo].recordBusy();
+				sendAnswer(1,F("feeder busy, advance queue full"));
+				break;
+			}
+
 			//start feeding
 			bool triggerFeedOK = feeders[(uint16_t)signedFeederNo].advance(feedLength, overrideError);
 			if(!triggerFeedOK)
@@ -346,6 +672,105 @@ void processCommand()
 			break;
 		}
 
+		case MCODE_ADVANCE_BATCH:
+		{
+			//1st to check: are feeder enabled?
+			if(checkEnabledFeedersError()) { break; }
+
+			if(advanceBatch.active)
+			{
+				sendAnswer(1, F("batch advance in progress"));
+				break;
+			}
+
+			bool overrideError = (parseParameter('X', -1) >= 1);
+
+			sGCodeList feederList;
+			sGCodeList lengthList;
+
+			if(!beginParameterList('N', &feederList))
+			{
+				sendAnswer(1, FLASH_ANSWER(answerFeederNoMissing));
+				break;
+			}
+
+			bool lengthListEnded = !beginParameterList('F', &lengthList);
+			int16_t feedLength = -1;		//-1: feeder's default feed length
+
+			//1st pass: validate everything before any feeder moves. feed length per feeder, ADVANCE_BATCH_NOT_LISTED if not in the batch
+			uint8_t batchFeedLength[NUMBER_OF_FEEDER];
+			memset(batchFeedLength, ADVANCE_BATCH_NOT_LISTED, sizeof(batchFeedLength));
+
+			bool valid = true;
+			uint8_t listedFeeders = 0;
+			int16_t signedFeederNo;
+
+			while(nextParameterListValue(&feederList, &signedFeederNo))
+			{
+				if(!validFeederNo(signedFeederNo) || batchFeedLength[signedFeederNo] != ADVANCE_BATCH_NOT_LISTED)
+				{
+					sendAnswer(1, F("feederNo invalid or listed twice"));
+					valid = false;
+					break;
+				}
+
+				//one F value per feeder, the last one given applies to the rest of the list
+				int16_t listedLength;
+				if(!lengthListEnded && nextParameterListValue(&lengthList, &listedLength))
+					feedLength = listedLength;
+				else
+					lengthListEnded = true;
+
+				int16_t length = (feedLength < 0) ? feeders[signedFeederNo].feederSettings.feed_length : feedLength;
+
+				if ( ((length%2) != 0) || length > 24 )
+				{
+					//advancing is only possible for multiples of 2mm and 24mm max
+					sendAnswer(1, FLASH_ANSWER(answerInvalidFeedLength));
+					valid = false;
+					break;
+				}
+
+				batchFeedLength[signedFeederNo] = length;
+				listedFeeders++;
+			}
+
+			if(!valid) { break; }
+
+			if(listedFeeders == 0)
+			{
+				sendAnswer(1, FLASH_ANSWER(answerFeederNoMissing));
+				break;
+			}
+
+			//2nd pass: start all feeders in this tick
+			memset(&advanceBatch, 0, sizeof(advanceBatch));
+
+			for (uint16_t i = 0; i < NUMBER_OF_FEEDER; i++)
+			{
+				if(batchFeedLength[i] == ADVANCE_BATCH_NOT_LISTED || batchFeedLength[i] == 0)
+					continue;
+
+				//left over from a batch aborted by M610 S0
+				clearFeederBit(FeederClass::motion.batchAdvanceAborted, i);
+
+				if(feeders[i].advanceQueueIsFull())
+				{
+					feeders[i].recordBusy();
+					setFeederBit(advanceBatch.busy, i);
+				}
+				else if(!feeders[i].advance(batchFeedLength[i], overrideError, true))
+					setFeederBit(advanceBatch.notOk, i);
+				else
+					setFeederBit(advanceBatch.pending, i);
+			}
+
+			//answer is sent by checkAdvanceBatch(), once all feeders settled
+			advanceBatch.active = true;
+
+			break;
+		}
+
 		case MCODE_RETRACT_POST_PICK:
 		{
 			//1st to check: are feeder enabled?
@@ -448,22 +873,26 @@ void processCommand()
 					updatedFeederSettings.feed_length = parseParameter('F', oldFeederSettings.feed_length);
 					updatedFeederSettings.advance_angle_speed = parseSpeedParameter('S', oldFeederSettings.advance_angle_speed);
 					updatedFeederSettings.retract_angle_speed = parseSpeedParameter('R', oldFeederSettings.retract_angle_speed);
+					updatedFeederSettings.advance_angle_acceleration = parseAccelerationParameter('P', oldFeederSettings.advance_angle_acceleration);
+					updatedFeederSettings.retract_angle_acceleration = parseAccelerationParameter('Q', oldFeederSettings.retract_angle_acceleration);
 					updatedFeederSettings.time_to_settle = parseParameter('U', oldFeederSettings.time_to_settle);
 					updatedFeederSettings.motor_min_pulsewidth = parseParameter('V', oldFeederSettings.motor_min_pulsewidth);
 					updatedFeederSettings.motor_max_pulsewidth = parseParameter('W', oldFeederSettings.motor_max_pulsewidth);
+					updatedFeederSettings.ignore_feedback = parseParameter('X', oldFeederSettings.ignore_feedback);
+					updatedFeederSettings.prefeed = parseParameter('Y', oldFeederSettings.prefeed);
 				
 					//set to feeder
 					feeders[i].setSettings(updatedFeederSettings);
 
-					//save to eeprom
+					//save to eeprom, written behind by the loop
 					feeders[i].saveFeederSettings();
 
-					//reattach servo with new settings
-					feeders[i].setup(servoControllers);
+					//put servo on retract position with new settings
+					feeders[i].gotoRetractPosition();
 				}
 
 				//confirm
-				sendAnswer(0, F("Feeders config updated."));
+				sendAnswer(0, FLASH_ANSWER(answerConfigUpdated));
 
 				break;
 			}
@@ -481,29 +910,100 @@ void processCommand()
 					//set to feeder
 					feeders[i].setSettings(settings);
 
-					//save to eeprom
+					//save to eeprom, written behind by the loop
 					feeders[i].saveFeederSettings();
 
-					//reattach servo with new settings
-					feeders[i].setup(servoControllers);
+					//put servo on retract position with new settings
+					feeders[i].gotoRetractPosition();
 				}
 
 				//confirm
-				sendAnswer(0, F("Feeders config updated."));
+				sendAnswer(0, FLASH_ANSWER(answerConfigUpdated));
 
 				break;
 			}
 
+		case MCODE_COMMIT_FEEDER_CONFIG:
+		{
+			uint16_t bytesWritten = commitFeederSettings();
+
+			sendAnswerPrefix(0);
+			serialTx.print(F("Feeders config saved to EEPROM, "));
+			serialTx.print(bytesWritten);
+			serialTx.println(F(" bytes written."));
+
+			break;
+		}
+
+		case MCODE_MOTION_ADMISSION_STATS:
+		{
+			//report and reset
+			sendAnswerPrefix(0);
+			serialTx.print(F("moves delayed: "));
+			serialTx.print(FeederClass::delayedMoves);
+			serialTx.print(F(", max wait: "));
+			serialTx.print(FeederClass::maxAdmissionWait);
+			serialTx.print(F(" ms, peak current: "));
+			serialTx.print(FeederClass::peakMovingCurrent);
+			serialTx.print(F(" mA of "));
+			serialTx.print(MOTION_CURRENT_BUDGET_MA);
+			serialTx.println(F(" mA"));
+
+			FeederClass::delayedMoves = 0;
+			FeederClass::maxAdmissionWait = 0;
+			FeederClass::peakMovingCurrent = FeederClass::movingCurrent;
+
+			break;
+		}
+
+#ifdef FEEDER_STATS
+		case MCODE_FEEDER_STATS:
+		{
+			int16_t signedFeederNo = (int)parseParameter('N', -1);
+			bool reset = (parseParameter('R', 0) >= 1);
+
+			if (signedFeederNo == -1)
+			{
+				//all feeders: printed (and reset) one per loop iteration by continueFeederDump()
+				feederDumpKind = reset ? DUMP_STATS_RESET : DUMP_STATS;
+				feederDumpNext = 0;
+			}
+			else if (validFeederNo(signedFeederNo))
+			{
+				feeders[(uint16_t)signedFeederNo].outputStats();
+				if (reset)
+					feeders[(uint16_t)signedFeederNo].resetStats();
+			}
+			else
+			{
+				sendAnswer(1, FLASH_ANSWER(answerFeederNoInvalid));
+			}
+			break;
+		}
+#endif
+
+#ifdef LATENCY_STATS
+		case MCODE_LATENCY_STATS:
+		{
+			//report and reset, printed one section per loop iteration by continueFeederDump(). it answers when done
+			feederDumpKind = DUMP_LATENCY;
+			feederDumpNext = 0;
+			latencyReportSection = REPORT_LOOP;
+			latencyReportItem = 0;
+
+			break;
+		}
+#endif
+
 		case MCODE_PRINT_FEEDER_CONFIG:
 		{
 			int16_t signedFeederNo = (int)parseParameter('N', -1);
 
 			if (signedFeederNo == -1)
 			{
-				for (uint16_t i = 0; i < NUMBER_OF_FEEDER; i++)
-				{
-					feeders[i].outputCurrentSettings();
-				}
+				//all feeders: printed one per loop iteration by continueFeederDump()
+				feederDumpKind = DUMP_SETTINGS;
+				feederDumpNext = 0;
 			}
 			else if (validFeederNo(signedFeederNo))
 			{
@@ -511,7 +1011,7 @@ void processCommand()
 			}
 			else
 			{
-				sendAnswer(1, F("feederNo invalid"));
+				sendAnswer(1, FLASH_ANSWER(answerFeederNoInvalid));
 			}
 			break;
 		}
@@ -534,6 +1034,143 @@ void processCommand()
 	}
 }
 
+#ifdef LATENCY_STATS
+//print the next line of the M632 report and reset what it showed (nothing recorded meanwhile is lost), false once answered
+bool continueLatencyReport()
+{
+	switch(latencyReportSection)
+	{
+		case REPORT_LOOP:
+			latencyPrint(F("loop"), &loopLatency);
+			memset(&loopLatency, 0, sizeof(loopLatency));
+			break;
+
+		case REPORT_COMMAND:
+			latencyPrint(F("command"), &commandLatency);
+			memset(&commandLatency, 0, sizeof(commandLatency));
+			break;
+
+		case REPORT_COMMANDS:
+			if(latencyPrintCommand(latencyReportItem))
+			{
+				latencyReportItem++;
+				return true;
+			}
+			latencyResetCommands();
+			latencyReportItem = 0;
+			latencyReportSection++;
+			return true;
+
+		case REPORT_I2C:
+		{
+			//the I²C statistics are updated by the interrupt: print copies
+			sLatencyHistogram i2cLatencyCopy;
+			I2C_ATOMIC {
+				i2cLatencyCopy = i2cLatency;
+				memset(&i2cLatency, 0, sizeof(i2cLatency));
+			}
+			latencyPrint(F("i2c"), &i2cLatencyCopy);
+			break;
+		}
+
+		case REPORT_CONTROLLERS:
+		{
+			uint16_t bursts;
+			unsigned long burstMax;
+			I2C_ATOMIC {
+				bursts = servoControllers[latencyReportItem].bursts;
+				burstMax = servoControllers[latencyReportItem].burstMax;
+				servoControllers[latencyReportItem].bursts = 0;
+				servoControllers[latencyReportItem].burstMax = 0;
+			}
+
+			serialTx.print(F("i2c PCA9685 n° "));
+			serialTx.print(latencyReportItem);
+			serialTx.print(F(" bursts="));
+			serialTx.print(bursts);
+			serialTx.print(F(" max="));
+			serialTx.print(burstMax);
+			serialTx.println(F("us"));
+
+			if(++latencyReportItem < NUMBER_OF_CONTROLLERS)
+				return true;
+			latencyReportItem = 0;
+			break;
+		}
+
+		case REPORT_BUDGET:
+			i2cBudgetPrint();
+			i2cBudgetReset();
+			break;
+
+		case REPORT_QUEUE:
+			i2cQueuePrintStats();
+			i2cQueueResetStats();
+			break;
+
+		case REPORT_SERIAL:
+			serialTx.print(F("serial tx stalls="));
+			serialTx.print(serialTx.stalls);
+			serialTx.print(F(" waited="));
+			serialTx.print(serialTx.stallTime);
+			serialTx.println(F("us"));
+
+			serialTx.stalls = 0;
+			serialTx.stallTime = 0;
+			break;
+
+		default:
+			sendAnswer(0, F("latency stats reset"));
+			return false;
+	}
+
+	latencyReportSection++;
+	return true;
+}
+#endif
+
+/**
+* Print the next feeder of a running M630/M633 dump, once the TX buffer has room for its line.
+* One line per call, so a dump of all feeders takes just a slice of each loop iteration.
+*/
+void continueFeederDump()
+{
+	if(feederDumpNext >= NUMBER_OF_FEEDER)
+	{
+		if(readyPending && serialTx.availableForWrite() >= FEEDER_DUMP_LINE_LENGTH)
+		{
+			serialTx.println(F("Controller up and ready! Have fun."));
+			readyPending = false;
+		}
+		return;
+	}
+
+	if(serialTx.availableForWrite() < FEEDER_DUMP_LINE_LENGTH)
+		return;
+
+	#ifdef LATENCY_STATS
+	if(feederDumpKind == DUMP_LATENCY)
+	{
+		if(!continueLatencyReport())
+			feederDumpNext = NUMBER_OF_FEEDER;
+		return;
+	}
+	#endif
+
+	#ifdef FEEDER_STATS
+	if(feederDumpKind != DUMP_SETTINGS)
+	{
+		feeders[feederDumpNext].outputStats();
+		if(feederDumpKind == DUMP_STATS_RESET)
+			feeders[feederDumpNext].resetStats();
+		feederDumpNext++;
+		return;
+	}
+	#endif
+
+	feeders[feederDumpNext++].outputCurrentSettings();
+}
+
 void listenToSerialStream()
 {
 	while (Serial.available())
@@ -543,29 +1180,56 @@ void listenToSerialStream()
 
 		// print back for debugging
 		#ifdef DEBUG
-		Serial.print(receivedChar);
+		serialTx.print(receivedChar);
 		#endif
 
-		// add to buffer
-		inputBuffer += receivedChar;
-
 		// if the received character is a newline, processCommand
 		if (receivedChar == '\n')
 		{
-			//remove comments
-			inputBuffer.remove(inputBuffer.indexOf(";"));
-			inputBuffer.trim();
+			if (inputBufferOverflow)
+				sendAnswer(1, F("line too long, command ignored"));
+			else
+			{
+				#ifdef LATENCY_STATS
+				unsigned long commandStart = micros();
+				#endif
 
+				processCommand();
 
-			processCommand();
+				#ifdef LATENCY_STATS
+				latencyRecordCommand(parseParameter('M', -1), micros() - commandStart);
+				#endif
+			}
 
 			//clear buffer
-			inputBuffer="";
+			inputBufferLength = 0;
+			inputBufferOverflow = false;
+		}
+		else if (inputBufferLength < MAX_BUFFFER_MCODE_LINE)
+		{
+			// add to buffer
+			inputBuffer[inputBufferLength++] = receivedChar;
+		}
+		else
+		{
+			inputBufferOverflow = true;
 		}
 	}
 }
 
 
+#ifdef RAMEND
+//the large globals of all modules and a stack reserve against the whole RAM. the small ones and the core's are left to
+//scripts/ram_report.py, which fails the build on the linked figures
+#ifdef LATENCY_STATS
+#define LATENCY_STATS_RAM (sizeof(loopLatency) + sizeof(commandLatency) + sizeof(i2cLatency) + sizeof(commandLatencies))
+#else
+#define LATENCY_STATS_RAM 0
+#endif
+static_assert(sizeof(feeders) + sizeof(FeederClass::motion) + sizeof(servoControllers) + sizeof(serialTx) + sizeof(inputBuffer)
+	+ GCODE_PARAMETERS_RAM + I2C_QUEUE_RAM + LATENCY_STATS_RAM + RAM_STACK_RESERVE <= RAMEND - RAMSTART + 1,
+	"static RAM and RAM_STACK_RESERVE are more than the RAM");
+#endif
 
 // ------------------  S E T U P -----------------------
 void setup()
@@ -574,37 +1238,36 @@ void setup()
 
 	while (!Serial);
 
-	Serial.println(F("Controller starting...")); Serial.flush();
-	Serial.println(F("Here is some stuff saved in EEPROM. Paste in a textfile to backup these settings...")); Serial.flush();
+	serialTx.println(F("Controller starting...")); serialTx.flush();
+	serialTx.println(F("Here is some stuff saved in EEPROM. Paste in a textfile to backup these settings...")); serialTx.flush();
 
-	Serial.println("Controller has " + String(NUMBER_OF_FEEDER) + " feeders with " + String(NUMBER_OF_CONTROLLERS) + " PCA9685."); Serial.flush();
+	serialTx.print(F("Controller has "));
+	serialTx.print(NUMBER_OF_FEEDER);
+	serialTx.print(F(" feeders with "));
+	serialTx.print(NUMBER_OF_CONTROLLERS);
+	serialTx.println(F(" PCA9685.")); serialTx.flush();
 
 	/** Create instances of PCA9685 with incremental addresses
 	*	PCA #1 manage feeders 1 - 16, #2 17 - 32, etc.
 	*/
+	ServoControllerClass::resetDevices();
 	for (uint8_t i = 0; i < NUMBER_OF_CONTROLLERS; i++)
 	{
-		Serial.print(F("Initializing PCA9685 n° "));
-		Serial.println(i); Serial.flush();
-
-		// servoControllers[i] = PCA9685();
+		serialTx.print(F("Initializing PCA9685 n° "));
+		serialTx.println(i); serialTx.flush();
 
-		servoControllers[i].resetDevices();
-		// delay(10);
-		servoControllers[i].init(PCA9685_PhaseBalancer_Linear, PCA9685_OutputDriverMode_TotemPole, PCA9685_OutputEnabledMode_Normal, PCA9685_OutputDisabledMode_Low, PCA9685_ChannelUpdateMode_AfterAck);
-		// delay(10);
-		servoControllers[i].setPWMFreqServo();
-		// delay(10);
-		servoControllers[i].setAllChannelsPWM(310);
-		// delay(10);
+		servoControllers[i].begin(controllerAddress(i));
 
 		// for (uint8_t j = 0; j < 16; j++)
 		// {
-		// 	Serial.println("Turning off channel " + String(j) + " of PCA n°" + String(i));
 		// 	servoControllers[i].setChannelOff(j);
 		// 	// delay(10);
 		// }	
 	}
+
+	#ifdef HAS_FEEDBACKLINES
+	feedbackLinesBegin();
+	#endif
 	
 	// setup listener to serial stream
 	setupGCodeProc();
@@ -613,13 +1276,37 @@ void setup()
 	//needs to be done before factory reset to have a valid ID (eeprom-settings location is derived off the ID)
 	executeCommandOnAllFeeder(cmdInitializeFeederWithId);
 
+	//EEPROMex refuses every write after its first 100 calls (write, update or block): a factory reset alone takes more.
+	//allow as many as its int counts
+	EEPROM.setMaxAllowedWrites(32767);
+
 	//load commonSettings from eeprom
 	EEPROM.readBlock(EEPROM_COMMON_SETTINGS_ADDRESS_OFFSET, commonSettings);
 
+	//settings of an older firmware: convert them to records, keeping every feeder's calibration
+	uint8_t legacySize = 0;
+	if(strncmp(commonSettings.version, EEPROM_LEGACY_VERSION_SPEED, sizeof(commonSettings.version)) == 0)
+		legacySize = EEPROM_LEGACY_SIZE_SPEED;
+	else if(strncmp(commonSettings.version, EEPROM_LEGACY_VERSION_ACCELERATION, sizeof(commonSettings.version)) == 0)
+		legacySize = EEPROM_LEGACY_SIZE_ACCELERATION;
+
+	if(legacySize != 0)
+	{
+		serialTx.print(F("Migrating feeder settings of config version "));
+		serialTx.println(commonSettings.version);
+
+		//records take more room than the old layout: read all first, then write all
+		for (uint16_t i = 0; i < NUMBER_OF_FEEDER; i++)
+			feeders[i].loadLegacyFeederSettings(legacySize);
+		for (uint16_t i = 0; i < NUMBER_OF_FEEDER; i++)
+			feeders[i].commitSettings();
+
+		EEPROM.writeBlock(EEPROM_COMMON_SETTINGS_ADDRESS_OFFSET, commonSettings_default);
+	}
 	//factory reset on first start or version changing
-	if(strcmp(commonSettings.version,CONFIG_VERSION) != 0)
+	else if(strncmp(commonSettings.version, CONFIG_VERSION, sizeof(commonSettings.version)) != 0)
 	{
-		Serial.println(F("First start/Config version changed"));
+		serialTx.println(F("First start/Config version changed"));
 
 		//reset needed
 		executeCommandOnAllFeeder(cmdFactoryReset);
@@ -631,15 +1318,28 @@ void setup()
 	//print all settings to console
 	// printCommonSettings();
 
+	//moves to retract are stepped from here on
+	motionTimerBegin();
+
 	//setup feeder objects
 	executeCommandOnAllFeeder(cmdSetup);	//setup everything first, then power on short. made it this way to prevent servos from driving to an undefined angle while being initialized
-	delay(1000);		//have the last feeder's servo settled before disabling
+	if (flushServoControllers())
+		i2cFlushDone(millis());
+
+	//wait until the feeders that had to move to retract settled. feeders restored at retract did not move at all.
+	//the servo writes keep to the bus budget like in loop()
+	unsigned long homingStart = millis();
+	while (anyFeederActive() && millis() - homingStart < BOOT_HOMING_TIMEOUT_MS)
+	{
+		delay(1);
+		runMotionFrame();
+	}
 	// executeCommandOnAllFeeder(cmdDisable); //while setup ran, the feeder were moved and remain in sIDLE-state -> it shall be disabled
-	
-	//print all settings of every feeder to console
-	executeCommandOnAllFeeder(cmdOutputCurrentSettings);
 
-	Serial.println(F("Controller up and ready! Have fun."));
+	//print all settings of every feeder to console, one per loop iteration, then announce being ready
+	feederDumpKind = DUMP_SETTINGS;
+	feederDumpNext = 0;
+	readyPending = true;
 }
 
 
@@ -647,11 +1347,40 @@ void setup()
 // ------------------  L O O P -----------------------
 void loop()
 {
-	// Process incoming serial data and perform callbacks
-	listenToSerialStream();
+	#ifdef LATENCY_STATS
+	unsigned long loopStart = micros();
+	#endif
+
+	// Process incoming serial data and perform callbacks, not before a running settings dump is done (keeps the answers in order)
+	if(feederDumpNext >= NUMBER_OF_FEEDER && !readyPending)
+		listenToSerialStream();
+	else
+		continueFeederDump();
+
+	// Process servo control of moving feeders
+	runMotionFrame();
+
+	// Answer a batch advance once all its feeders settled
+	checkAdvanceBatch();
 
-	// Process servo control
-	executeCommandOnAllFeeder(cmdUpdate);
+	// Tell once about a controller that stopped answering
+	reportOfflineControllers();
+
+	#ifdef HAS_FEEDBACKLINES
+	// Read the feedback lines of all feeders (one I²C read per port expander), start manual feeds
+	feedbackLinesScan(millis());
+	checkManualFeeds();
+	#endif
+
+	// Send buffered answers, as much as the port takes without waiting
+	serialTx.drain();
+
+	// Write changed feeder settings and lever positions to EEPROM, a byte at a time
+	persistSettingsStep();
+
+	#ifdef LATENCY_STATS
+	latencyRecord(&loopLatency, micros() - loopStart);
+	#endif
 
 	// delay(5);
 }
@@ -0,0 +1,168 @@
+/*
+*  Tests of advance commands as a host sees them ([env:native], pio test -e native).
+*
+*  The firmware boots in the simulator, G-code lines go in through the simulated serial port
+*  and loop() runs on the virtual clock until the answers came back.
+*/
+
+#include <unity.h>
+
+#include "Sim.h"
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+// firmware, src/main.cpp
+void setup();
+void loop();
+
+static std::string output;		// serial output since the last clearOutput()
+
+static void captureTx(uint8_t c, void *context) {
+	output += (char)c;
+}
+
+static void clearOutput() {
+	output.clear();
+}
+
+//loop() for /ms/ of virtual time, 100 µs per iteration like the simulator
+static void runFor(unsigned long ms) {
+	uint64_t end = sim::now() + (uint64_t)ms * 1000;
+	while (sim::now() < end) {
+		loop();
+		sim::advance(100);
+	}
+}
+
+static void send(const char *line) {
+	sim::feedSerial(line);
+	sim::feedSerial("\n");
+}
+
+//lines of the output since the last clearOutput() starting with /answer/
+static int countAnswers(const char *answer) {
+	int count = 0;
+	size_t start = 0;
+	while (start < output.size()) {
+		size_t end = output.find('\n', start);
+		if (end == std::string::npos)
+			end = output.size();
+		if (output.compare(start, strlen(answer), answer) == 0)
+			count++;
+		start = end + 1;
+	}
+	return count;
+}
+
+//boot, then enable the feeders
+void setUp() {
+	clearOutput();
+	sim::setSerialTxHook(captureTx, NULL);
+	setup();
+	runFor(1000);
+	send("M610 S1");
+	runFor(100);
+	TEST_ASSERT_EQUAL(1, countAnswers("ok Feeder set enabled"));
+	clearOutput();
+}
+
+void tearDown() {
+	sim::setSerialTxHook(NULL, NULL);
+}
+
+static void test_full_queue_answers_busy() {
+	//one running, FEEDER_ADVANCE_QUEUE_LENGTH queued, the next one is refused at once
+	for (uint8_t i = 0; i < FEEDER_ADVANCE_QUEUE_LENGTH + 2; i++)
+		send("M600 N2 X1");
+	runFor(100);
+	TEST_ASSERT_EQUAL(1, countAnswers("error feeder busy, advance queue full"));
+	TEST_ASSERT_EQUAL(0, countAnswers("ok"));
+
+	runFor((FEEDER_ADVANCE_QUEUE_LENGTH + 1) * 1000);
+	TEST_ASSERT_EQUAL(FEEDER_ADVANCE_QUEUE_LENGTH + 1, countAnswers("ok, advancing cycle completed"));
+	TEST_ASSERT_EQUAL(1, countAnswers("error"));
+}
+
+static void test_batch_answers_once() {
+	send("M605 N0:7 X1");
+	runFor(3000);
+	TEST_ASSERT_EQUAL(1, countAnswers("ok, batch advancing cycle completed"));
+	//no answer per feeder
+	TEST_ASSERT_EQUAL(1, countAnswers("ok"));
+	TEST_ASSERT_EQUAL(0, countAnswers("error"));
+}
+
+static void test_batch_aborted_by_m610() {
+	send("M605 N3,4 X1");
+	runFor(5);
+	send("M610 S1");
+	runFor(3000);
+	TEST_ASSERT_EQUAL(1, countAnswers("ok Feeder set enabled"));
+	TEST_ASSERT_EQUAL(1, countAnswers("error batch advance failed: N3 aborted N4 aborted"));
+	TEST_ASSERT_EQUAL(0, countAnswers("ok, batch"));
+}
+
+//M631 after a batch of feeders 0../last/: longest wait [ms] and peak current [mA] of the admission
+static void runAdmittedBatch(int last, unsigned long *maxWait, unsigned long *peakCurrent) {
+	char line[32];
+	snprintf(line, sizeof(line), "M605 N0:%d X1", last);
+	send(line);
+	runFor(5000);
+	clearOutput();
+	send("M631");
+	runFor(100);
+	unsigned long delayed;
+	TEST_ASSERT_EQUAL(3, sscanf(output.c_str(), "ok moves delayed: %lu, max wait: %lu ms, peak current: %lu mA", &delayed, maxWait, peakCurrent));
+}
+
+static void test_admission_delays_moves_over_budget() {
+	const int moving = MOTION_CURRENT_BUDGET_MA / MOTION_MOVE_CURRENT_MA;
+	unsigned long maxWait;
+	unsigned long peakCurrent;
+
+	send("M631");
+	runFor(100);
+
+	//as many as the budget lets move at once: only the start stagger
+	runAdmittedBatch(moving - 1, &maxWait, &peakCurrent);
+	TEST_ASSERT_LESS_OR_EQUAL(moving * MOTION_START_STAGGER_MS, maxWait);
+	TEST_ASSERT_LESS_OR_EQUAL(MOTION_CURRENT_BUDGET_MA, peakCurrent);
+
+	//twice as many: the others wait for moves to finish
+	runAdmittedBatch(2 * moving - 1, &maxWait, &peakCurrent);
+	TEST_ASSERT_GREATER_THAN(moving * MOTION_START_STAGGER_MS + 100, maxWait);
+	TEST_ASSERT_LESS_OR_EQUAL(MOTION_CURRENT_BUDGET_MA, peakCurrent);
+}
+
+static void test_prefed_part_answers_without_move() {
+	send("M620 N5 Y1");
+	send("M600 N5 X1");
+	runFor(2000);
+	//retract, then feed the next part without an answer
+	send("M601 N5");
+	runFor(3000);
+	TEST_ASSERT_EQUAL(1, countAnswers("ok, advancing cycle completed"));
+
+	clearOutput();
+	unsigned long channelWrites = sim::counters.channelWrites;
+	send("M600 N5 X1");
+	runFor(50);
+	TEST_ASSERT_EQUAL(1, countAnswers("ok, advancing cycle completed"));
+	TEST_ASSERT_EQUAL(channelWrites, sim::counters.channelWrites);
+
+	send("M620 N5 Y0");
+	runFor(100);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_full_queue_answers_busy);
+	RUN_TEST(test_batch_answers_once);
+	RUN_TEST(test_batch_aborted_by_m610);
+	RUN_TEST(test_admission_delays_moves_over_budget);
+	RUN_TEST(test_prefed_part_answers_without_move);
+	return UNITY_END();
+}
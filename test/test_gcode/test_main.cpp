@@ -0,0 +1,152 @@
+/*
+*  Unit tests of the G-code line parser in src/gcode.cpp ([env:native], pio test -e native).
+*
+*  Lines are put into the firmware's input buffer as listenToSerialStream() leaves them
+*  (without the line end) and parsed like processCommand() does.
+*/
+
+#include <unity.h>
+
+#include "gcode.h"
+
+#include <stdint.h>
+#include <string.h>
+
+static void parseLine(const char *line) {
+	inputBufferLength = strlen(line);
+	memcpy(inputBuffer, line, inputBufferLength);
+	parseGCodeLine();
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+static void test_integer_parameters() {
+	parseLine("M600 N3 F4");
+	TEST_ASSERT_EQUAL_INT32(600, parseParameter('M', -1));
+	TEST_ASSERT_EQUAL_INT32(3, parseParameter('N', -1));
+	TEST_ASSERT_EQUAL_INT32(4, parseParameter('F', -1));
+	TEST_ASSERT_EQUAL_INT32(-1, parseParameter('X', -1));
+}
+
+static void test_fixed_point_value() {
+	int32_t value;
+
+	parseLine("M620 N3 S1.5 R-0.25");
+	TEST_ASSERT_TRUE(findParameter('S', &value));
+	TEST_ASSERT_EQUAL_INT32(15000, value);
+	TEST_ASSERT_TRUE(findParameter('R', &value));
+	TEST_ASSERT_EQUAL_INT32(-2500, value);
+	TEST_ASSERT_FALSE(findParameter('P', &value));
+}
+
+static void test_decimals_truncated() {
+	int32_t value;
+
+	//integer parameters take the integer part only
+	parseLine("M600 N3.9 F-2.5");
+	TEST_ASSERT_EQUAL_INT32(3, parseParameter('N', -1));
+	TEST_ASSERT_EQUAL_INT32(-2, parseParameter('F', -1));
+
+	//decimals beyond GCODE_FIXED_POINT_DECIMALS are dropped, not rounded
+	parseLine("M620 S0.123456789");
+	TEST_ASSERT_TRUE(findParameter('S', &value));
+	TEST_ASSERT_EQUAL_INT32(1234, value);
+}
+
+static void test_integer_part_saturates() {
+	parseLine("M620 N3 U99999999");
+	TEST_ASSERT_EQUAL_INT32(99999, parseParameter('U', -1));
+	TEST_ASSERT_EQUAL_INT32(3, parseParameter('N', -1));
+}
+
+static void test_rate_rounding() {
+	//0.5021 * 256 = 128.54
+	parseLine("M620 S0.5021 R1.5");
+	TEST_ASSERT_EQUAL_UINT16(129, parseSpeedParameter('S', 7));
+	TEST_ASSERT_EQUAL_UINT16(384, parseSpeedParameter('R', 7));
+
+	//a rate that rounds to 0 is kept at the smallest step, 0 itself disables
+	parseLine("M620 P0.0001 Q0");
+	TEST_ASSERT_EQUAL_UINT16(1, parseAccelerationParameter('P', 7));
+	TEST_ASSERT_EQUAL_UINT16(0, parseAccelerationParameter('Q', 7));
+
+	//saturated, negative or missing
+	parseLine("M620 S300 R-1");
+	TEST_ASSERT_EQUAL_UINT16(65535, parseSpeedParameter('S', 7));
+	TEST_ASSERT_EQUAL_UINT16(7, parseSpeedParameter('R', 7));
+	TEST_ASSERT_EQUAL_UINT16(7, parseAccelerationParameter('P', 7));
+}
+
+static void test_comment_ignored() {
+	parseLine("M600 N3 ; F8 X1");
+	TEST_ASSERT_EQUAL_INT32(3, parseParameter('N', -1));
+	TEST_ASSERT_EQUAL_INT32(-1, parseParameter('F', -1));
+	TEST_ASSERT_EQUAL_INT32(-1, parseParameter('X', -1));
+
+	parseLine(";M600 N3");
+	TEST_ASSERT_EQUAL_INT32(-1, parseParameter('M', -1));
+}
+
+static void test_lowercase_and_compact() {
+	parseLine("m600 n3 f8");
+	TEST_ASSERT_EQUAL_INT32(600, parseParameter('M', -1));
+	TEST_ASSERT_EQUAL_INT32(3, parseParameter('N', -1));
+	TEST_ASSERT_EQUAL_INT32(8, parseParameter('F', -1));
+
+	parseLine("M600N3F8\r");
+	TEST_ASSERT_EQUAL_INT32(600, parseParameter('M', -1));
+	TEST_ASSERT_EQUAL_INT32(3, parseParameter('N', -1));
+	TEST_ASSERT_EQUAL_INT32(8, parseParameter('F', -1));
+}
+
+static void test_list_with_range() {
+	sGCodeList list;
+	int16_t value;
+	const int16_t expected[] = {1, 4, 6, 7, 8, 9};
+
+	parseLine("M605 N1,4,6:9 F4,8");
+	TEST_ASSERT_TRUE(beginParameterList('N', &list));
+	for (uint8_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+		TEST_ASSERT_TRUE(nextParameterListValue(&list, &value));
+		TEST_ASSERT_EQUAL_INT16(expected[i], value);
+	}
+	TEST_ASSERT_FALSE(nextParameterListValue(&list, &value));
+
+	TEST_ASSERT_TRUE(beginParameterList('F', &list));
+	TEST_ASSERT_TRUE(nextParameterListValue(&list, &value));
+	TEST_ASSERT_EQUAL_INT16(4, value);
+	TEST_ASSERT_TRUE(nextParameterListValue(&list, &value));
+	TEST_ASSERT_EQUAL_INT16(8, value);
+	TEST_ASSERT_FALSE(nextParameterListValue(&list, &value));
+
+	TEST_ASSERT_FALSE(beginParameterList('X', &list));
+}
+
+static void test_list_ends_on_garbage() {
+	sGCodeList list;
+	int16_t value;
+
+	parseLine("M605 N3,x,5");
+	TEST_ASSERT_TRUE(beginParameterList('N', &list));
+	TEST_ASSERT_TRUE(nextParameterListValue(&list, &value));
+	TEST_ASSERT_EQUAL_INT16(3, value);
+	TEST_ASSERT_FALSE(nextParameterListValue(&list, &value));
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_integer_parameters);
+	RUN_TEST(test_fixed_point_value);
+	RUN_TEST(test_decimals_truncated);
+	RUN_TEST(test_integer_part_saturates);
+	RUN_TEST(test_rate_rounding);
+	RUN_TEST(test_comment_ignored);
+	RUN_TEST(test_lowercase_and_compact);
+	RUN_TEST(test_list_with_range);
+	RUN_TEST(test_list_ends_on_garbage);
+	return UNITY_END();
+}
@@ -0,0 +1,165 @@
+/*
+*  Unit tests of the feeder settings records and the migration of older EEPROM layouts
+*  ([env:native], pio test -e native).
+*
+*  An EEPROM image as an older firmware left it is put into the simulated cells, then setup()
+*  boots on it like the controller would after the update.
+*/
+
+#include <unity.h>
+
+#include "Feeder.h"
+
+#include <string.h>
+
+// firmware, src/main.cpp
+void setup();
+extern FeederClass feeders[];
+
+//calibration of feeder n as an older firmware stored it, different for every feeder
+static FeederClass::sFeederSettings legacySettings(uint16_t n) {
+	FeederClass::sFeederSettings settings = FeederClass().feederSettings;
+	settings.full_advanced_angle = 150 + n % 20;
+	settings.half_advanced_angle = 100 + n % 20;
+	settings.retract_angle = 20 + n % 20;
+	settings.feed_length = 2 + 2 * (n % 4);
+	settings.time_to_settle = 200 + n;
+	settings.advance_angle_speed = 300 + n;
+	settings.retract_angle_speed = 600 + n;
+	settings.motor_min_pulsewidth = 90 + n;
+	settings.motor_max_pulsewidth = 580 + n;
+	settings.advance_angle_acceleration = 40 + n;
+	settings.retract_angle_acceleration = 80 + n;
+	return settings;
+}
+
+//erased eeprom, common settings of /version/, then /legacySize/ bytes of settings per feeder
+static void writeLegacyImage(const char *version, uint8_t legacySize) {
+	memset(EEPROM.cells, 0xFF, sizeof(EEPROM.cells));
+	memcpy(&EEPROM.cells[EEPROM_COMMON_SETTINGS_ADDRESS_OFFSET], version, strlen(version) + 1);
+
+	for (uint16_t i = 0; i < NUMBER_OF_FEEDER; i++) {
+		FeederClass::sFeederSettings settings = legacySettings(i);
+		memcpy(&EEPROM.cells[EEPROM_FEEDER_SETTINGS_ADDRESS_OFFSET + i * legacySize], &settings, legacySize);
+	}
+}
+
+//settings record of feeder n as stored now, read by a feeder object of its own
+static bool loadRecord(uint16_t n, FeederClass::sFeederSettings *settings) {
+	FeederClass feeder;
+	feeder.initialize(n);
+	bool loaded = feeder.loadFeederSettings();
+	*settings = feeder.feederSettings;
+	return loaded;
+}
+
+static void assertCommonSettingsCurrent() {
+	TEST_ASSERT_EQUAL_STRING(CONFIG_VERSION, (const char *)&EEPROM.cells[EEPROM_COMMON_SETTINGS_ADDRESS_OFFSET]);
+}
+
+//setup() runs once per test: start from the settings a power on leaves in RAM
+void setUp() {
+	for (uint16_t i = 0; i < NUMBER_OF_FEEDER; i++)
+		feeders[i].feederSettings = FeederClass().feederSettings;
+}
+
+void tearDown() {
+}
+
+static void test_migrate_acceleration_layout() {
+	writeLegacyImage(EEPROM_LEGACY_VERSION_ACCELERATION, EEPROM_LEGACY_SIZE_ACCELERATION);
+	setup();
+
+	const FeederClass::sFeederSettings defaults = FeederClass().feederSettings;
+	for (uint16_t i = 0; i < NUMBER_OF_FEEDER; i++) {
+		FeederClass::sFeederSettings expected = legacySettings(i);
+		//not in the old layout: defaults
+		expected.ignore_feedback = defaults.ignore_feedback;
+		expected.prefeed = defaults.prefeed;
+
+		TEST_ASSERT_EQUAL_MEMORY(&expected, &feeders[i].feederSettings, sizeof(expected));
+
+		FeederClass::sFeederSettings stored;
+		TEST_ASSERT_TRUE(loadRecord(i, &stored));
+		TEST_ASSERT_EQUAL_MEMORY(&expected, &stored, sizeof(expected));
+	}
+	assertCommonSettingsCurrent();
+}
+
+static void test_migrate_speed_layout() {
+	writeLegacyImage(EEPROM_LEGACY_VERSION_SPEED, EEPROM_LEGACY_SIZE_SPEED);
+	setup();
+
+	const FeederClass::sFeederSettings defaults = FeederClass().feederSettings;
+	for (uint16_t i = 0; i < NUMBER_OF_FEEDER; i++) {
+		FeederClass::sFeederSettings expected = legacySettings(i);
+		expected.advance_angle_acceleration = defaults.advance_angle_acceleration;
+		expected.retract_angle_acceleration = defaults.retract_angle_acceleration;
+		expected.ignore_feedback = defaults.ignore_feedback;
+		expected.prefeed = defaults.prefeed;
+
+		FeederClass::sFeederSettings stored;
+		TEST_ASSERT_TRUE(loadRecord(i, &stored));
+		TEST_ASSERT_EQUAL_MEMORY(&expected, &stored, sizeof(expected));
+	}
+	assertCommonSettingsCurrent();
+}
+
+static void test_record_crc_detects_damage() {
+	writeLegacyImage(EEPROM_LEGACY_VERSION_ACCELERATION, EEPROM_LEGACY_SIZE_ACCELERATION);
+	setup();
+
+	FeederClass::sFeederSettings stored;
+	uint16_t address = EEPROM_FEEDER_SETTINGS_ADDRESS_OFFSET + 3 * FEEDER_SETTINGS_RECORD_SLOT;
+
+	//a torn write of one settings byte
+	EEPROM.cells[address + 2] ^= 0x10;
+	TEST_ASSERT_FALSE(loadRecord(3, &stored));
+	EEPROM.cells[address + 2] ^= 0x10;
+	TEST_ASSERT_TRUE(loadRecord(3, &stored));
+
+	//record of another schema
+	EEPROM.cells[address] ^= 0xFF;
+	TEST_ASSERT_FALSE(loadRecord(3, &stored));
+	EEPROM.cells[address] ^= 0xFF;
+
+	//the neighbours are not touched
+	TEST_ASSERT_TRUE(loadRecord(2, &stored));
+	TEST_ASSERT_TRUE(loadRecord(4, &stored));
+}
+
+static void test_shorter_record_gets_defaults() {
+	writeLegacyImage(EEPROM_LEGACY_VERSION_ACCELERATION, EEPROM_LEGACY_SIZE_ACCELERATION);
+	setup();
+
+	//record of a firmware without the last settings field: shorter length, crc over what it has
+	uint16_t address = EEPROM_FEEDER_SETTINGS_ADDRESS_OFFSET + 5 * FEEDER_SETTINGS_RECORD_SLOT;
+	uint8_t length = sizeof(FeederClass::sFeederSettings) - 1;
+	EEPROM.cells[address + 1] = length;
+	FeederClass feeder;
+	feeder.initialize(5);
+	uint8_t crc = 0;
+	for (uint8_t i = 0; i < length + 2; i++) {
+		crc ^= EEPROM.cells[address + i];
+		for (uint8_t bit = 0; bit < 8; bit++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0x8C : (crc >> 1);
+	}
+	EEPROM.cells[address + 2 + length] = crc;
+
+	TEST_ASSERT_TRUE(feeder.loadFeederSettings());
+	FeederClass::sFeederSettings expected = legacySettings(5);
+	expected.ignore_feedback = FeederClass().feederSettings.ignore_feedback;
+	expected.prefeed = FeederClass().feederSettings.prefeed;
+	TEST_ASSERT_EQUAL_MEMORY(&expected, &feeder.feederSettings, sizeof(expected));
+	//queued for the write behind with the full length
+	TEST_ASSERT_TRUE(FeederClass::unsavedSettings[5 >> 3] & (1 << (5 & 7)));
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_migrate_acceleration_layout);
+	RUN_TEST(test_migrate_speed_layout);
+	RUN_TEST(test_record_crc_detects_damage);
+	RUN_TEST(test_shorter_record_gets_defaults);
+	return UNITY_END();
+}
@@ -0,0 +1,169 @@
+/*
+*  Digital twin of the feeder controller ([env:twin]).
+*
+*  Runs the firmware against the stand-ins in sim/ in real time and exposes its serial port
+*  on a pseudo-terminal, so OpenPnP or scripts/loadgen.py connect to it like to the Teensy.
+*  Every PCA9685 channel drives a modelled servo that follows its pulse at a limited speed.
+*  The virtual clock follows the wall clock; delay() and a full serial TX buffer let it run
+*  ahead, like they block the controller.
+*
+*  usage: twin [-v] [-l link] [-e eeprom.bin] [-s servo_deg_per_s]
+*    -v    trace pwm writes, servo moves and serial output on stderr
+*    -l    symlink to the pty, e.g. /tmp/feeder (removed on exit)
+*    -e    EEPROM image, loaded on start (if present) and saved on exit
+*    -s    servo speed, default 600 °/s (SG90: 0.1 s per 60°)
+*
+*  stops on SIGINT/SIGTERM and prints the simulator counters.
+*/
+
+#include "Sim.h"
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+void setup();
+void loop();
+
+#define TWIN_LOOP_US 100		// wall clock time per loop() iteration, at least
+
+static volatile sig_atomic_t stopRequested = 0;
+static int ptyMaster = -1;
+
+static void onSignal(int signal) {
+	(void)signal;
+	stopRequested = 1;
+}
+
+static uint64_t wallUs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// what the firmware sends goes to the pty. With nobody reading, bytes are dropped once the pty buffer is full
+static void onSerialTx(uint8_t c, void *context) {
+	(void)context;
+	while (write(ptyMaster, &c, 1) < 0) {
+		struct pollfd pfd = { ptyMaster, POLLOUT, 0 };
+		if (errno != EINTR && (errno != EAGAIN || poll(&pfd, 1, 100) <= 0))
+			return;
+	}
+}
+
+static void receiveSerial() {
+	char buffer[256];
+	ssize_t n = read(ptyMaster, buffer, sizeof(buffer) - 1);
+	if (n <= 0)
+		return;
+	buffer[n] = '\0';
+	//NUL bytes would end the string early, the firmware does not expect them anyway
+	for (ssize_t i = 0; i < n; i++)
+		if (buffer[i] == '\0')
+			buffer[i] = ' ';
+	sim::feedSerial(buffer);
+}
+
+static int openPty(char *slavePath, size_t size) {
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0 || ptsname_r(master, slavePath, size) != 0) {
+		perror("pty");
+		return -1;
+	}
+
+	//raw, like a USB serial port: no echo, no line editing, no CR/LF translation
+	struct termios tio;
+	tcgetattr(master, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(master, TCSANOW, &tio);
+
+	fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+	return master;
+}
+
+int main(int argc, char **argv) {
+	const char *eepromImage = NULL;
+	const char *link = NULL;
+	bool verbose = false;
+	float servoSpeed = 600;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-v") == 0) {
+			verbose = true;
+		} else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+			link = argv[++i];
+		} else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+			eepromImage = argv[++i];
+		} else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			servoSpeed = atof(argv[++i]);
+		} else {
+			fprintf(stderr, "usage: %s [-v] [-l link] [-e eeprom.bin] [-s servo_deg_per_s]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	char slavePath[64];
+	ptyMaster = openPty(slavePath, sizeof(slavePath));
+	if (ptyMaster < 0)
+		return 1;
+	//keep the slave open: clients may come and go without the master seeing a hangup
+	int slave = open(slavePath, O_RDWR | O_NOCTTY);
+
+	if (link) {
+		unlink(link);
+		if (symlink(slavePath, link) < 0) {
+			perror(link);
+			link = NULL;
+		}
+	}
+	printf("twin on %s%s%s\n", slavePath, link ? " -> " : "", link ? link : "");
+	fflush(stdout);
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+
+	if (eepromImage)
+		sim::loadEEPROM(eepromImage);
+
+	sim::setTrace(verbose ? stderr : NULL);
+	sim::setServoModel(FEEDER_DEFAULT_MOTOR_MIN_PULSEWIDTH, FEEDER_DEFAULT_MOTOR_MAX_PULSEWITH, servoSpeed / 1000);
+	sim::setSerialTxHook(onSerialTx, NULL);
+
+	uint64_t wallStart = wallUs();
+	setup();
+
+	while (!stopRequested) {
+		uint64_t loopStart = wallUs();
+		loop();
+		sim::updateServos();
+		uint64_t spent = wallUs() - loopStart;
+		if (spent < TWIN_LOOP_US)
+			usleep(TWIN_LOOP_US - spent);
+		receiveSerial();
+
+		//virtual time catches up with the wall clock, it never goes back
+		uint64_t wall = wallUs() - wallStart;
+		if (wall > sim::now())
+			sim::advance(wall - sim::now());
+	}
+
+	printf("stopped after %.3f s\n", sim::now() / 1000000.0);
+	sim::printCounters(stdout, "stat ");
+
+	if (eepromImage && !sim::saveEEPROM(eepromImage))
+		perror(eepromImage);
+	if (link)
+		unlink(link);
+	if (slave >= 0)
+		close(slave);
+	close(ptyMaster);
+	return 0;
+}